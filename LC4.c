@@ -3,6 +3,16 @@
  */
 
 #include "LC4.h"
+#include "profile.h"
+#include "trap.h"
+#include "devices.h"
+#include "journal.h"
+#include "fusion.h"
+#include "tracefile.h"
+#include "pipeline.h"
+#include "cache.h"
+#include "disasm.h"
+#include "statehash.h"
 #include <stdio.h>
 
 // macro definitions
@@ -15,6 +25,9 @@
 #define INSN_RT_0(I) I & 0x7            // Rt name
 #define INSN_CMP_7(I) I >> 7 & 0x3      // For CMP operations, the instruction type
 
+// hooks turned on by the optional subsystems
+unsigned int SimHooks = 0;
+
 //sign extend helper function
 short int Sext(unsigned short int value, unsigned int numBits) {
     int sign = (value >> (numBits - 1)) & 1;
@@ -35,6 +48,9 @@ void Reset(MachineState* CPU)
 
     CPU->PC = 0x8200;
     CPU->PSR = 0x8002;
+    CPU->cycle = 0;
+    CPU->memoryHash = 0;    // the hash of zeroed memory
+    CPU->memory = CPU->store;
 
     for (i = 0; i < 8; i++) {
         CPU->R[i] = 0;
@@ -48,6 +64,19 @@ void Reset(MachineState* CPU)
 }
 
 
+/*
+ * Copy the machine state from into to. A machine with its own memory gets
+ * its own copy of it; one sharing memory keeps sharing.
+ */
+void CopyMachineState(MachineState* to, MachineState* from)
+{
+    memcpy(to, from, sizeof(MachineState));
+    if (from->memory == from->store) {
+        to->memory = to->store;
+    }
+}
+
+
 /*
  * Clear all of the control signals (set to 0)
  */
@@ -68,12 +97,41 @@ void ClearSignals(MachineState* CPU)
 }
 
 
+/*
+ * Write the cycle count, PC, PSR and registers of the CPU to output in readable form.
+ */
+void PrintState(MachineState* CPU, FILE* output)
+{
+    int i;
+
+    fprintf(output, "cycle %llu PC %04X PSR %04X NZP %d\n", CPU->cycle, CPU->PC, CPU->PSR, CPU->NZPVal);
+    for (i = 0; i < 8; i++) {
+        fprintf(output, "R%d %04X%s", i, CPU->R[i], i == 7 ? "\n" : " ");
+    }
+}
+
+
 /*
  * This function should write out the current state of the CPU to the file output.
  */
 void WriteOut(MachineState* CPU, FILE* output)
 {
     unsigned short int inst = CPU->memory[CPU->PC];
+    TraceRecord record;
+
+    // tracing is turned off
+    if (output == NULL) {
+        return;
+    }
+    PROFILE_BEGIN(write);
+
+    // fixed size record instead of a text line
+    if (TraceFormat == TRACE_BINARY) {
+        FillTraceRecord(CPU, &record);
+        fwrite(&record, sizeof(record), 1, output);
+        PROFILE_END(write, PROFILE_WRITE_OUT);
+        return;
+    }
 
     // print to file
     // 1.the current PC 
@@ -121,9 +179,20 @@ void WriteOut(MachineState* CPU, FILE* output)
     // 10.what value is being loaded or stored into memory
     fprintf(output, " %04X", CPU->dmemValue);
 
+    // 11.optionally, the hash of the state the instruction started from
+    if (SimHooks & HOOK_STATE_HASH) {
+        StateHashWriteColumn(output);
+    }
+
+    // 12.optionally, the instruction in assembly
+    if (DisasmColumn) {
+        DisasmWrite(output, CPU->PC, inst);
+    }
+
     // close the current line
     fprintf(output, "\n");
 
+    PROFILE_END(write, PROFILE_WRITE_OUT);
     return;
 }
 
@@ -143,7 +212,11 @@ void LDROp(MachineState* CPU, FILE* output)
     CPU->rtMux_CTL = 0;                 //Rt Register not used
 
     CPU->dmemAddr = CPU->R[CPU->rsMux_CTL] + imm6;  //address
-    CPU->dmemValue = CPU->memory[CPU->dmemAddr];    //value
+    if (CPU->dmemAddr >= DeviceRegionStart) {   //memory-mapped device register
+        CPU->dmemValue = DeviceLoad(CPU, CPU->dmemAddr);
+    } else {
+        CPU->dmemValue = CPU->memory[CPU->dmemAddr];    //value
+    }
 
     //set input value to dmem[Rs + sext(IMM6)]
     CPU->regInputVal = CPU->dmemValue;
@@ -186,7 +259,13 @@ void STROp(MachineState* CPU, FILE* output)
     CPU->dmemAddr = CPU->R[CPU->rsMux_CTL] + imm6;  //address to store value in
     CPU->dmemValue = CPU->R[CPU->rtMux_CTL];    //value to store in address
 
+    if (StateHashOn) {      //keep the state hash current
+        StateHashWrite(CPU, CPU->dmemAddr, CPU->dmemValue);
+    }
     CPU->memory[CPU->dmemAddr]= CPU->dmemValue; //dmem[Rs + sext(IMM6)] = Rt
+    if (CPU->dmemAddr >= DeviceRegionStart) {   //memory-mapped device register
+        DeviceStore(CPU, CPU->dmemAddr, CPU->dmemValue);
+    }
 
     WriteOut(CPU, output);
 
@@ -324,6 +403,11 @@ void TrapOp(MachineState* CPU, FILE* output)
 
     CPU->PC = 0x8000 | (inst & 0xFF); //PC = (0x8000 | UIMM8)
     CPU->PSR = CPU->PSR | 0x8000; //PSR[15] = 1
+
+    // standard OS routines can be carried out without running the OS
+    if (TrapMode != TRAP_MODE_OS) {
+        TrapEmulate(CPU, inst & 0xFF, output);
+    }
 }
 
 int CheckErrors(MachineState* CPU) {
@@ -368,8 +452,10 @@ int CheckErrors(MachineState* CPU) {
 int UpdateMachineState(MachineState* CPU, FILE* output)
 {   
     // Get the current PC value
+    unsigned short int pc = CPU->PC;
     unsigned short int inst = CPU->memory[CPU->PC];
     unsigned short int inst_type = INSN_OP(inst);
+    unsigned int fused;
     
     //exit address check
     if (CPU->PC == 0x80FF) {
@@ -377,11 +463,37 @@ int UpdateMachineState(MachineState* CPU, FILE* output)
     }
 
     // has errors in the code
+    PROFILE_BEGIN(check);
     int errorCode = CheckErrors(CPU);
+    PROFILE_END(check, PROFILE_CHECK_ERRORS);
     if (errorCode > 0) {
         return errorCode;
     }
 
+    // optional hooks that need the state before the instruction executes
+    if (SimHooks) {
+        if (SimHooks & HOOK_JOURNAL) {
+            JournalRecord(CPU);
+        }
+        if (SimHooks & HOOK_STATE_HASH) {
+            StateHashRecord(CPU);
+        }
+    }
+
+    // common idioms run as one operation, as long as no hook needs to see each
+    // instruction and no device event falls inside them
+    if (FusionEnabled && !SimHooks) {
+        fused = ExecuteFused(CPU, output, NextEventCycle > CPU->cycle ? NextEventCycle - CPU->cycle : 0);
+        if (fused > 0) {
+            CPU->cycle += fused;
+            if (CPU->cycle >= NextEventCycle) {
+                ServiceEvents(CPU);
+            }
+            return 0;
+        }
+    }
+
+    PROFILE_BEGIN(handler);
     switch (inst_type) {
         case 0x0000:        // branch operations
             BranchOp(CPU, output);
@@ -432,6 +544,23 @@ int UpdateMachineState(MachineState* CPU, FILE* output)
         default:
             break;
     }
+    PROFILE_END(handler, inst_type);
+    CPU->cycle++;
+
+    // optional hooks that look at the finished instruction
+    if (SimHooks) {
+        if (SimHooks & HOOK_PIPELINE) {
+            PipelineRetire(CPU, pc, inst);
+        }
+        if (SimHooks & HOOK_CACHE) {
+            CacheRetire(CPU, pc, inst);
+        }
+    }
+
+    // devices only get a look in when one of their events is due
+    if (CPU->cycle >= NextEventCycle) {
+        ServiceEvents(CPU);
+    }
 
     return 0;
 }
@@ -766,8 +895,6 @@ void ShiftModOp(MachineState* CPU, FILE* output)
     // get current instruction
     unsigned short int inst = CPU->memory[CPU->PC];
     unsigned short int u_imm4 = inst & 0xF;
-    int i;
-    unsigned short int placeholder;
 
     CPU->regFile_WE = 1; //high
     CPU->DATA_WE = 0; //low
@@ -785,12 +912,8 @@ void ShiftModOp(MachineState* CPU, FILE* output)
         case 0:         // SLL Rd Rs UIMM4
             CPU->regInputVal = CPU->R[CPU->rsMux_CTL] << u_imm4; //Rd = Rs << UIMM4
             break;
-        case 1:         // SRA Rd Rs UIMM4           
-            placeholder = CPU->R[CPU->rsMux_CTL];    //preserve original value of RS
-            for (i = 0; i < u_imm4; i++) {  //for each iteration, arithmetic shift right once
-                placeholder = (placeholder & 0x8000) + (placeholder >> 1);
-            }
-            CPU->regInputVal = placeholder; //assign correct value
+        case 1:         // SRA Rd Rs UIMM4
+            CPU->regInputVal = (short int) CPU->R[CPU->rsMux_CTL] >> u_imm4; //Rd = Rs >>> UIMM4, sign bit copied in
             break;
         case 2:         // SRL Rd Rs UIMM4
             CPU->regInputVal = CPU->R[CPU->rsMux_CTL] >> u_imm4; //Rd = Rs >> UIMM4
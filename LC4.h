@@ -2,6 +2,9 @@
  * LC4.h: Declares simulator functions for executing instructions
  */
 
+#ifndef LC4_H
+#define LC4_H
+
 #include "string.h"
 #include <stdio.h>
 #include <stdlib.h>
@@ -33,10 +36,33 @@ typedef struct {
     unsigned short int dmemAddr;
     unsigned short int dmemValue;
 
-    // Machine memory - all of it
-    unsigned short int memory[65536];
+    // cycle: number of instructions executed since Reset
+    unsigned long long cycle;
+
+    // memoryHash: hash of memory, kept current while StateHashOn (statehash.h)
+    unsigned long long memoryHash;
+
+    // Machine memory - all of it. Points at store, or at the store of another
+    // machine when several cores share one memory
+    unsigned short int* memory;
+    unsigned short int store[65536];
 } MachineState;
 
+// Optional per-instruction hooks run by UpdateMachineState. While SimHooks is
+// 0 the plain execution path pays a single test for all of them.
+#define HOOK_JOURNAL 0x1        // record undo information for reverse stepping
+#define HOOK_PIPELINE 0x2       // pipelined datapath timing model
+#define HOOK_CACHE 0x4          // instruction and data cache simulator
+#define HOOK_STATE_HASH 0x8     // state hash column of the trace
+
+extern unsigned int SimHooks;
+
+
+/*
+ * Sign extend the low numBits bits of value.
+ */
+short int Sext(unsigned short int value, unsigned int numBits);
+
 
 /*
  * This function should execute one LC4 datapath cycle.
@@ -46,6 +72,7 @@ int UpdateMachineState(MachineState* CPU, FILE* output);
 
 /*
  * This function should write out the current state of the CPU to the file output.
+ * Nothing is written when output is NULL (tracing turned off).
  */
 void WriteOut(MachineState* CPU, FILE* output);
 
@@ -92,6 +119,50 @@ void JSROp(MachineState* CPU, FILE* output);
 void ShiftModOp(MachineState* CPU, FILE* output);
 
 
+/*
+ * This handles LDR instructions.
+ */
+void LDROp(MachineState* CPU, FILE* output);
+
+
+/*
+ * This handles STR instructions.
+ */
+void STROp(MachineState* CPU, FILE* output);
+
+
+/*
+ * This handles RTI instructions.
+ */
+void RTIOp(MachineState* CPU, FILE* output);
+
+
+/*
+ * This handles CONST instructions.
+ */
+void ConstOp(MachineState* CPU, FILE* output);
+
+
+/*
+ * This handles HICONST instructions.
+ */
+void HiConstOp(MachineState* CPU, FILE* output);
+
+
+/*
+ * This handles TRAP instructions.
+ */
+void TrapOp(MachineState* CPU, FILE* output);
+
+
+/*
+ * Check the instruction at PC for access violations: returns 1 for executing
+ * data as code, 2 for reading code as data, 3 for OS access without privilege
+ * and 0 if it may execute.
+ */
+int CheckErrors(MachineState* CPU);
+
+
 /*
  * Set the NZP bits in the PSR.
  */
@@ -104,7 +175,22 @@ void SetNZP(MachineState* CPU, short result);
 void Reset(MachineState* CPU);
 
 
+/*
+ * Copy the machine state from into to. A machine with its own memory gets
+ * its own copy of it; one sharing memory keeps sharing.
+ */
+void CopyMachineState(MachineState* to, MachineState* from);
+
+
 /*
  * Clear all of the internal values (set to 0)
  */
-void ClearSignals(MachineState* CPU);
\ No newline at end of file
+void ClearSignals(MachineState* CPU);
+
+
+/*
+ * Write the cycle count, PC, PSR and registers of the CPU to output in readable form.
+ */
+void PrintState(MachineState* CPU, FILE* output);
+
+#endif
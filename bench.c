@@ -0,0 +1,115 @@
+/*
+ * bench.c: location of main() for the interpreter core benchmark
+ *
+ * Runs the same ALU-heavy loop without a trace through the UpdateMachineState
+ * switch and through the InsnTable core and reports the simulated MIPS of each,
+ * then the rate at which the cache simulator handles accesses.
+ * Build with optimization for meaningful numbers: make CFLAGS=-O2 bench
+ */
+
+#include <stddef.h>
+#include <time.h>
+#include "LC4.h"
+#include "fastcore.h"
+#include "cache.h"
+
+#define DEFAULT_RUNS 20
+#define CACHE_ACCESSES 100000000
+
+// OS: hand control straight to user code at x0000
+static const unsigned short int osCode[] = {
+    0x9E00,     // x8200  CONST R7, #0
+    0x8000      // x8201  RTI
+};
+
+// user code: 30000 passes of a 9 instruction loop body
+static const unsigned short int userCode[] = {
+    0x9230,     // x0000  CONST R1, x30
+    0xD275,     // x0001  HICONST R1, x75        ; R1 = 30000
+    0x1481,     // x0002  LOOP ADD R2, R2, R1
+    0x1689,     // x0003  MUL R3, R2, R1
+    0x58DA,     // x0004  XOR R4, R3, R2
+    0xAB23,     // x0005  SRL R5, R4, #3
+    0x5D44,     // x0006  AND R6, R5, R4
+    0x2D05,     // x0007  CMPI R6, #5
+    0x0800,     // x0008  BRn x0009
+    0x127F,     // x0009  ADD R1, R1, #-1
+    0x03F7,     // x000A  BRp LOOP
+    0xF0FF      // x000B  TRAP xFF
+};
+
+static MachineState image;
+static MachineState machine;
+
+//helper function to time runs of one core, returns the simulated MIPS
+static double Measure(int (*step)(MachineState*, FILE*), int runs, MachineState* final)
+{
+    struct timespec start, stop;
+    unsigned long long retired = 0;
+    double seconds;
+    int i;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < runs; i++) {
+        CopyMachineState(&machine, &image);
+        while (step(&machine, NULL) == 0) {
+        }
+        retired += machine.cycle;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+
+    CopyMachineState(final, &machine);
+    seconds = (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) / 1e9;
+    return retired / seconds / 1e6;
+}
+
+//helper function to time the cache model on a loop fetching and walking an array,
+//returns millions of accesses per second
+static double MeasureCache(void)
+{
+    CacheConfig config = { 1024, 4, 2, CACHE_LRU };
+    struct timespec start, stop;
+    unsigned int i;
+    double seconds;
+
+    CacheInit(CACHE_INSTRUCTION, &config);
+    CacheInit(CACHE_DATA, &config);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < CACHE_ACCESSES / 2; i++) {
+        machine.dmemAddr = 0x4000 + (i * 3 & 0x1FFF);
+        CacheRetire(&machine, i & 0x3F, 0x6000);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+
+    seconds = (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) / 1e9;
+    return CACHE_ACCESSES / seconds / 1e6;
+}
+
+int main(int argc, char** argv)
+{
+    static MachineState switchFinal, tableFinal;
+    int runs = argc > 1 ? atoi(argv[1]) : DEFAULT_RUNS;
+    double switchMips, tableMips;
+
+    Reset(&image);
+    memcpy(&image.memory[0x8200], osCode, sizeof(osCode));
+    memcpy(&image.memory[0x0000], userCode, sizeof(userCode));
+
+    switchMips = Measure(UpdateMachineState, runs, &switchFinal);
+    tableMips = Measure(UpdateMachineStateFast, runs, &tableFinal);
+
+    printf("instructions per run: %llu\n", switchFinal.cycle);
+    printf("switch core: %8.2f MIPS\n", switchMips);
+    printf("table core:  %8.2f MIPS (%.2fx)\n", tableMips, tableMips / switchMips);
+
+    // both cores have to end in exactly the same state
+    if (memcmp(&switchFinal, &tableFinal, offsetof(MachineState, memory)) != 0
+            || memcmp(switchFinal.memory, tableFinal.memory, sizeof(switchFinal.store)) != 0) {
+        printf("error: final machine states differ\n");
+        return 1;
+    }
+
+    printf("cache model: %8.2f M accesses/s\n", MeasureCache());
+    return 0;
+}
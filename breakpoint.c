@@ -0,0 +1,189 @@
+/*
+ * breakpoint.c: Defines breakpoints, watchpoints and the checked engine
+ *
+ * Each kind of stop is a map with one bit per address. The plain engines
+ * never look at the maps; trace switches to UpdateMachineStateChecked only
+ * when something is set.
+ */
+
+#include "breakpoint.h"
+#include "loader.h"
+
+#define MAP_BYTES (65536 / 8)
+#define IS_SET(map, address) ((map)[(address) >> 3] & (1 << ((address) & 7)))
+
+int (*CheckedStep)(MachineState* CPU, FILE* output) = UpdateMachineState;
+int BreakLogOnly = 0;
+
+static unsigned char executeMap[MAP_BYTES];
+static unsigned char readMap[MAP_BYTES];
+static unsigned char writeMap[MAP_BYTES];
+static int armed = 0;
+
+// a stop before PC resumePC has been reported; let that instruction run next time
+static int resuming = 0;
+static unsigned short int resumePC = 0;
+
+/*
+ * Set the kinds of stop in kind on location, a label of the loaded objects
+ * or a hex address (x3000 or 0x3000). Returns -1 if location is unknown.
+ */
+int BreakpointAdd(int kind, char* location)
+{
+    int address = LookupSymbol(location);
+    char* end;
+
+    if (address < 0) {
+        address = strtol(location[0] == 'x' || location[0] == 'X' ? location + 1 : location, &end, 16);
+        if (*location == '\0' || *end != '\0' || address < 0 || address > 0xFFFF) {
+            return -1;
+        }
+    }
+
+    if (kind & BREAK_EXECUTE) {
+        executeMap[address >> 3] |= 1 << (address & 7);
+    }
+    if (kind & BREAK_READ) {
+        readMap[address >> 3] |= 1 << (address & 7);
+    }
+    if (kind & BREAK_WRITE) {
+        writeMap[address >> 3] |= 1 << (address & 7);
+    }
+    armed = 1;
+    return 0;
+}
+
+/*
+ * Read breakpoint commands from filename, one per line:
+ *   break LOC, watch LOC (writes), watch-read LOC, watch-access LOC, log
+ * Blank lines and lines starting with # are ignored. Returns -1 on errors.
+ */
+int BreakpointLoad(char* filename)
+{
+    FILE* input_p = fopen(filename, "r");
+    char line[256];
+    char command[32];
+    char location[224];
+    int fields, kind;
+    int lineNumber = 0;
+
+    if (input_p == NULL) {
+        perror("error: Cannot open the breakpoint file");
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), input_p) != NULL) {
+        lineNumber++;
+        fields = sscanf(line, "%31s %223s", command, location);
+        if (fields <= 0 || command[0] == '#') {
+            continue;
+        }
+
+        if (strcmp(command, "log") == 0) {
+            BreakLogOnly = 1;
+            continue;
+        }
+        if (strcmp(command, "break") == 0) {
+            kind = BREAK_EXECUTE;
+        } else if (strcmp(command, "watch") == 0) {
+            kind = BREAK_WRITE;
+        } else if (strcmp(command, "watch-read") == 0) {
+            kind = BREAK_READ;
+        } else if (strcmp(command, "watch-access") == 0) {
+            kind = BREAK_READ | BREAK_WRITE;
+        } else {
+            kind = 0;
+        }
+
+        if (kind == 0 || fields < 2 || BreakpointAdd(kind, location) == -1) {
+            fprintf(stderr, "error: %s:%d: cannot use \"%s\"\n", filename, lineNumber, strtok(line, "\n"));
+            fclose(input_p);
+            return -1;
+        }
+    }
+
+    fclose(input_p);
+    return 0;
+}
+
+/*
+ * Returns 1 if any breakpoint or watchpoint is set.
+ */
+int BreakpointsArmed(void)
+{
+    return armed;
+}
+
+//helper function to write an address with the symbol it falls after, if any
+static void PrintLocation(unsigned short int address)
+{
+    const char* name = NearestSymbol(address);
+    int offset;
+
+    if (name != NULL) {
+        offset = address - LookupSymbol((char*) name);
+        if (offset != 0) {
+            fprintf(stderr, "%04X (%s+%d)", address, name, offset);
+        } else {
+            fprintf(stderr, "%04X (%s)", address, name);
+        }
+    } else {
+        fprintf(stderr, "%04X", address);
+    }
+}
+
+/*
+ * Execute one cycle on CheckedStep, stopping with BREAK_STOPPED before a
+ * breakpoint PC or after a watched access. Hits are reported to stderr.
+ */
+int UpdateMachineStateChecked(MachineState* CPU, FILE* output)
+{
+    unsigned short int pc = CPU->PC;
+    unsigned short int inst = CPU->memory[pc];
+    unsigned short int address = 0;
+    unsigned short int oldMemory = 0;
+    unsigned short int oldRd = 0;
+    unsigned long long cycle = CPU->cycle;
+    int watched = 0;
+    int status;
+
+    if (IS_SET(executeMap, pc) && !(resuming && resumePC == pc)) {
+        fprintf(stderr, "breakpoint at PC ");
+        PrintLocation(pc);
+        fprintf(stderr, " cycle %llu\n", cycle);
+        if (!BreakLogOnly) {
+            resuming = 1;
+            resumePC = pc;
+            return BREAK_STOPPED;
+        }
+    }
+    resuming = 0;
+
+    // LDR and STR: work out the address now so the old contents can be shown
+    if ((inst >> 13) == 0x3) {
+        address = CPU->R[inst >> 6 & 0x7] + Sext(inst & 0x3F, 6);
+        watched = IS_SET(inst >> 12 == 0x6 ? readMap : writeMap, address);
+        oldMemory = CPU->memory[address];
+        oldRd = CPU->R[inst >> 9 & 0x7];
+    }
+
+    status = CheckedStep(CPU, output);
+    if (!watched || status != 0) {
+        return status;
+    }
+
+    if (inst >> 12 == 0x6) {
+        fprintf(stderr, "watchpoint: read ");
+        PrintLocation(address);
+        fprintf(stderr, " = 0x%04X into R%d 0x%04X -> 0x%04X at PC ", CPU->dmemValue,
+                inst >> 9 & 0x7, oldRd, CPU->R[inst >> 9 & 0x7]);
+    } else {
+        fprintf(stderr, "watchpoint: write ");
+        PrintLocation(address);
+        fprintf(stderr, " 0x%04X -> 0x%04X at PC ", oldMemory, CPU->dmemValue);
+    }
+    PrintLocation(pc);
+    fprintf(stderr, " cycle %llu\n", cycle);
+
+    return BreakLogOnly ? 0 : BREAK_STOPPED;
+}
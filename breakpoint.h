@@ -0,0 +1,49 @@
+/*
+ * breakpoint.h: Declares breakpoints, watchpoints and the checked engine
+ */
+
+#ifndef LC4_BREAKPOINT_H
+#define LC4_BREAKPOINT_H
+
+#include <stdio.h>
+#include "LC4.h"
+
+// Kinds of stop, one 64K-bit map each
+#define BREAK_EXECUTE 0x1       // before the instruction at the address runs
+#define BREAK_READ 0x2          // after an LDR from the address
+#define BREAK_WRITE 0x4         // after an STR to the address
+
+// Returned by UpdateMachineStateChecked when a breakpoint or watchpoint hits
+#define BREAK_STOPPED 5
+
+// Engine that UpdateMachineStateChecked runs each instruction on
+extern int (*CheckedStep)(MachineState* CPU, FILE* output);
+
+// If set, hits are reported and the run continues instead of stopping
+extern int BreakLogOnly;
+
+/*
+ * Set the kinds of stop in kind on location, a label of the loaded objects
+ * or a hex address (x3000 or 0x3000). Returns -1 if location is unknown.
+ */
+int BreakpointAdd(int kind, char* location);
+
+/*
+ * Read breakpoint commands from filename, one per line:
+ *   break LOC, watch LOC (writes), watch-read LOC, watch-access LOC, log
+ * Blank lines and lines starting with # are ignored. Returns -1 on errors.
+ */
+int BreakpointLoad(char* filename);
+
+/*
+ * Returns 1 if any breakpoint or watchpoint is set.
+ */
+int BreakpointsArmed(void);
+
+/*
+ * Execute one cycle on CheckedStep, stopping with BREAK_STOPPED before a
+ * breakpoint PC or after a watched access. Hits are reported to stderr.
+ */
+int UpdateMachineStateChecked(MachineState* CPU, FILE* output);
+
+#endif
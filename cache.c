@@ -0,0 +1,256 @@
+/*
+ * cache.c: Defines the instruction and data cache simulator
+ *
+ * Each set keeps its tags in an array ordered most recently used first, so a
+ * hit on the last line touched costs one compare and LRU replacement is a
+ * short shift within the set. Tags are block numbers plus one, 0 marks an
+ * empty way.
+ */
+
+#include "cache.h"
+#include "loader.h"
+
+#define TOP_MISSES 10
+
+typedef struct {
+    CacheConfig config;
+    unsigned int lineShift;
+    unsigned int setMask;
+    unsigned int* tags;                 // sets * assoc
+    unsigned int* missesAt;             // per PC of the instruction
+    unsigned long long accesses;
+    unsigned long long misses;
+} Cache;
+
+static Cache caches[2];
+static Cache* instructionCache = NULL;
+static Cache* dataCache = NULL;
+static unsigned int randomState = 0x2545F491;
+
+//helper function to find log2 of a power of two, -1 for anything else
+static int Log2(unsigned int value)
+{
+    int bits = 0;
+
+    if (value == 0 || (value & (value - 1)) != 0) {
+        return -1;
+    }
+    while ((1U << bits) != value) {
+        bits++;
+    }
+    return bits;
+}
+
+/*
+ * Parse SIZE:LINE:ASSOC[:lru|random] into config. Returns -1 if spec is
+ * malformed or a field is not a power of two.
+ */
+int CacheParse(char* spec, CacheConfig* config)
+{
+    char policy[16] = "lru";
+
+    if (sscanf(spec, "%u:%u:%u:%15s", &config->size, &config->line, &config->assoc, policy) < 3) {
+        return -1;
+    }
+    if (strcmp(policy, "lru") == 0) {
+        config->replacement = CACHE_LRU;
+    } else if (strcmp(policy, "random") == 0) {
+        config->replacement = CACHE_RANDOM;
+    } else {
+        return -1;
+    }
+
+    if (Log2(config->size) < 0 || Log2(config->line) < 0 || Log2(config->assoc) < 0
+            || config->size > 65536 || config->line * config->assoc > config->size) {
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Start simulating a cache of the given kind. Returns -1 if the tables
+ * cannot be allocated.
+ */
+int CacheInit(int kind, CacheConfig* config)
+{
+    Cache* cache = &caches[kind == CACHE_DATA ? 1 : 0];
+    unsigned int sets = config->size / config->line / config->assoc;
+
+    cache->config = *config;
+    cache->lineShift = Log2(config->line);
+    cache->setMask = sets - 1;
+    cache->accesses = 0;
+    cache->misses = 0;
+    cache->tags = calloc(sets * config->assoc, sizeof(unsigned int));
+    cache->missesAt = calloc(65536, sizeof(unsigned int));
+    if (cache->tags == NULL || cache->missesAt == NULL) {
+        return -1;
+    }
+
+    if (kind != CACHE_DATA) {
+        instructionCache = cache;
+    }
+    if (kind != CACHE_INSTRUCTION) {
+        dataCache = cache;
+    }
+    SimHooks |= HOOK_CACHE;
+    return 0;
+}
+
+//helper function to look address up in cache, filling the line on a miss
+static inline void Access(Cache* cache, unsigned short int address, unsigned short int pc)
+{
+    unsigned int block = address >> cache->lineShift;
+    unsigned int tag = block + 1;
+    unsigned int assoc = cache->config.assoc;
+    unsigned int* set = &cache->tags[(block & cache->setMask) * assoc];
+    unsigned int way;
+
+    cache->accesses++;
+    if (set[0] == tag) {
+        return;
+    }
+
+    for (way = 1; way < assoc && set[way] != tag; way++) {
+    }
+    if (way == assoc) {
+        cache->misses++;
+        cache->missesAt[pc]++;
+        if (cache->config.replacement == CACHE_LRU) {
+            way--;      // the last way is the least recently used
+        }
+    } else if (cache->config.replacement != CACHE_LRU) {
+        return;
+    }
+
+    if (cache->config.replacement == CACHE_LRU) {
+        // sets are a few ways long, a plain loop beats calling memmove
+        for (; way > 0; way--) {
+            set[way] = set[way - 1];
+        }
+        set[0] = tag;
+        return;
+    }
+
+    // random: fill an empty way first, otherwise evict any line
+    for (way = 0; way < assoc && set[way] != 0; way++) {
+    }
+    if (way == assoc) {
+        randomState ^= randomState << 13;
+        randomState ^= randomState >> 17;
+        randomState ^= randomState << 5;
+        way = randomState & (assoc - 1);
+    }
+    set[way] = tag;
+}
+
+/*
+ * Run the fetch of the instruction inst at pc, and its data access if it
+ * was a load or store, through the caches.
+ */
+void CacheRetire(MachineState* CPU, unsigned short int pc, unsigned short int inst)
+{
+    if (instructionCache != NULL) {
+        Access(instructionCache, pc, pc);
+    }
+    if (dataCache != NULL && (inst >> 13) == 0x3) {
+        Access(dataCache, CPU->dmemAddr, pc);
+    }
+}
+
+//helper function to pick the indices of the largest counts, largest first
+static int TopEntries(unsigned long long* counts, int n, int* top)
+{
+    unsigned long long best;
+    int numTop, i, j;
+
+    for (numTop = 0; numTop < TOP_MISSES; numTop++) {
+        best = 0;
+        for (i = 0; i < n; i++) {
+            for (j = 0; j < numTop && top[j] != i; j++) {
+            }
+            if (j == numTop && counts[i] > best) {
+                best = counts[i];
+                top[numTop] = i;
+            }
+        }
+        if (best == 0) {
+            break;
+        }
+    }
+    return numTop;
+}
+
+//helper function to write the statistics of one cache
+static void ReportCache(FILE* output, const char* kind, Cache* cache)
+{
+    unsigned long long* counts = malloc(65536 * sizeof(unsigned long long));
+    const char** names = malloc(65536 * sizeof(char*));
+    const char* name;
+    int top[TOP_MISSES];
+    int numTop, numNames, i;
+    unsigned int pc;
+
+    fprintf(output, "%s cache: %u words, %u-word lines, %u-way, %s\n", kind,
+            cache->config.size, cache->config.line, cache->config.assoc,
+            cache->config.replacement == CACHE_LRU ? "LRU" : "random");
+    fprintf(output, "accesses         %llu\n", cache->accesses);
+    fprintf(output, "misses           %llu (%.2f%%)\n", cache->misses,
+            cache->accesses > 0 ? 100.0 * cache->misses / cache->accesses : 0.0);
+    if (counts == NULL || names == NULL || cache->misses == 0) {
+        free(counts);
+        free(names);
+        return;
+    }
+
+    for (pc = 0; pc <= 0xFFFF; pc++) {
+        counts[pc] = cache->missesAt[pc];
+    }
+    numTop = TopEntries(counts, 65536, top);
+    fprintf(output, "  PC     misses  symbol\n");
+    for (i = 0; i < numTop; i++) {
+        name = NearestSymbol(top[i]);
+        fprintf(output, "  %04X %8llu  %s\n", top[i], counts[top[i]], name != NULL ? name : "-");
+    }
+
+    // symbols cover contiguous address ranges, so misses group by runs of PCs
+    numNames = 0;
+    for (pc = 0; pc <= 0xFFFF; pc++) {
+        if (cache->missesAt[pc] == 0) {
+            continue;
+        }
+        name = NearestSymbol(pc);
+        if (numNames == 0 || names[numNames - 1] != name) {
+            names[numNames] = name;
+            counts[numNames] = 0;
+            numNames++;
+        }
+        counts[numNames - 1] += cache->missesAt[pc];
+    }
+    numTop = TopEntries(counts, numNames, top);
+    fprintf(output, "  symbol               misses\n");
+    for (i = 0; i < numTop; i++) {
+        fprintf(output, "  %-16s %10llu\n", names[top[i]] != NULL ? names[top[i]] : "-", counts[top[i]]);
+    }
+
+    free(counts);
+    free(names);
+}
+
+/*
+ * Write hit and miss totals for each cache and the PCs and symbols with the
+ * most misses.
+ */
+void CacheReport(FILE* output)
+{
+    if (instructionCache != NULL && instructionCache == dataCache) {
+        ReportCache(output, "unified", instructionCache);
+        return;
+    }
+    if (instructionCache != NULL) {
+        ReportCache(output, "instruction", instructionCache);
+    }
+    if (dataCache != NULL) {
+        ReportCache(output, "data", dataCache);
+    }
+}
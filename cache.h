@@ -0,0 +1,52 @@
+/*
+ * cache.h: Declares the instruction and data cache simulator
+ */
+
+#ifndef LC4_CACHE_H
+#define LC4_CACHE_H
+
+#include <stdio.h>
+#include "LC4.h"
+
+// Replacement policies
+#define CACHE_LRU 0
+#define CACHE_RANDOM 1
+
+// Which accesses a cache sees
+#define CACHE_INSTRUCTION 0     // fetches at PC
+#define CACHE_DATA 1            // LDR and STR at dmemAddr
+#define CACHE_UNIFIED 2         // one cache for both
+
+// Sizes are in 16-bit words and must be powers of two
+typedef struct {
+    unsigned int size;          // total capacity
+    unsigned int line;          // words per line
+    unsigned int assoc;         // ways per set, size / line for fully associative
+    int replacement;
+} CacheConfig;
+
+/*
+ * Parse SIZE:LINE:ASSOC[:lru|random] into config. Returns -1 if spec is
+ * malformed or a field is not a power of two.
+ */
+int CacheParse(char* spec, CacheConfig* config);
+
+/*
+ * Start simulating a cache of the given kind. Returns -1 if the tables
+ * cannot be allocated.
+ */
+int CacheInit(int kind, CacheConfig* config);
+
+/*
+ * Run the fetch of the instruction inst at pc, and its data access if it
+ * was a load or store, through the caches.
+ */
+void CacheRetire(MachineState* CPU, unsigned short int pc, unsigned short int inst);
+
+/*
+ * Write hit and miss totals for each cache and the PCs and symbols with the
+ * most misses.
+ */
+void CacheReport(FILE* output);
+
+#endif
@@ -0,0 +1,360 @@
+/*
+ * devices.c: Defines the memory-mapped device bus, console, timer and event queue
+ */
+
+#include <poll.h>
+#include "devices.h"
+
+#define CONSOLE_BUFFER_SIZE 4096
+
+typedef struct {
+    unsigned short int start;
+    unsigned short int end;
+    DeviceLoadFn load;
+    DeviceStoreFn store;
+} Device;
+
+typedef struct {
+    unsigned long long cycle;
+    DeviceEventFn fn;
+} Event;
+
+unsigned int DeviceRegionStart = 0x10000;
+unsigned long long NextEventCycle = NO_EVENT;
+unsigned int TimerCyclesPerMs = 1000;
+
+static Device devices[MAX_DEVICES];
+static int numDevices = 0;
+
+// binary min-heap ordered by cycle
+static Event events[MAX_EVENTS];
+static int numEvents = 0;
+
+static char consoleBuffer[CONSOLE_BUFFER_SIZE];
+static int consoleLength = 0;
+static FILE* consoleInput = NULL;
+static int consoleLookahead = EOF;      // a character KBSR saw ready, not yet read
+static int consoleEnded = 0;
+
+static unsigned short int timerInterval = 0;
+static unsigned long long timerDeadline = NO_EVENT;
+static int timerElapsed = 0;
+
+/*
+ * Send loads and stores to addresses start..end (inclusive) to a device.
+ * Returns -1 if the bus is full.
+ */
+int RegisterDevice(unsigned short int start, unsigned short int end, DeviceLoadFn load, DeviceStoreFn store)
+{
+    if (numDevices == MAX_DEVICES) {
+        return -1;
+    }
+
+    devices[numDevices].start = start;
+    devices[numDevices].end = end;
+    devices[numDevices].load = load;
+    devices[numDevices].store = store;
+    numDevices++;
+
+    if (start < DeviceRegionStart) {
+        DeviceRegionStart = start;
+    }
+    return 0;
+}
+
+/*
+ * Read from a device register (plain memory if no device claims it).
+ */
+unsigned short int DeviceLoad(MachineState* CPU, unsigned short int address)
+{
+    int i;
+
+    for (i = 0; i < numDevices; i++) {
+        if (address >= devices[i].start && address <= devices[i].end && devices[i].load != NULL) {
+            return devices[i].load(CPU, address);
+        }
+    }
+    return CPU->memory[address];
+}
+
+/*
+ * Tell the device owning address that value was just stored there.
+ */
+void DeviceStore(MachineState* CPU, unsigned short int address, unsigned short int value)
+{
+    int i;
+
+    for (i = 0; i < numDevices; i++) {
+        if (address >= devices[i].start && address <= devices[i].end && devices[i].store != NULL) {
+            devices[i].store(CPU, address, value);
+            return;
+        }
+    }
+}
+
+//helper function to move the event in slot i up or down to its place in the heap
+static void SiftEvent(int i)
+{
+    Event swap;
+    int child;
+
+    while (i > 0 && events[(i - 1) / 2].cycle > events[i].cycle) {
+        swap = events[i];
+        events[i] = events[(i - 1) / 2];
+        events[(i - 1) / 2] = swap;
+        i = (i - 1) / 2;
+    }
+    while ((child = 2 * i + 1) < numEvents) {
+        if (child + 1 < numEvents && events[child + 1].cycle < events[child].cycle) {
+            child++;
+        }
+        if (events[i].cycle <= events[child].cycle) {
+            break;
+        }
+        swap = events[i];
+        events[i] = events[child];
+        events[child] = swap;
+        i = child;
+    }
+}
+
+/*
+ * Call fn once the machine reaches the given cycle. Returns -1 if the queue is full.
+ */
+int ScheduleEvent(unsigned long long cycle, DeviceEventFn fn)
+{
+    if (numEvents == MAX_EVENTS) {
+        return -1;
+    }
+
+    events[numEvents].cycle = cycle;
+    events[numEvents].fn = fn;
+    SiftEvent(numEvents++);
+
+    NextEventCycle = events[0].cycle;
+    return 0;
+}
+
+/*
+ * Drop every scheduled call of fn.
+ */
+void CancelEvent(DeviceEventFn fn)
+{
+    int i = 0;
+
+    while (i < numEvents) {
+        if (events[i].fn != fn) {
+            i++;
+            continue;
+        }
+        events[i] = events[--numEvents];
+        if (i < numEvents) {
+            SiftEvent(i);
+        }
+        i = 0;      // the heap moved around, so look again from the top
+    }
+
+    NextEventCycle = numEvents > 0 ? events[0].cycle : NO_EVENT;
+}
+
+/*
+ * Run every event that is due at the current cycle.
+ */
+void ServiceEvents(MachineState* CPU)
+{
+    DeviceEventFn fn;
+
+    while (numEvents > 0 && events[0].cycle <= CPU->cycle) {
+        fn = events[0].fn;
+
+        // move the last event to the root and sift it down
+        events[0] = events[--numEvents];
+        SiftEvent(0);
+
+        fn(CPU);    // may schedule further events
+    }
+
+    NextEventCycle = numEvents > 0 ? events[0].cycle : NO_EVENT;
+}
+
+/*
+ * Read console input from a file or pipe instead of stdin. Returns -1 on failure.
+ */
+int ConsoleOpenInput(char* filename)
+{
+    consoleInput = fopen(filename, "r");
+    if (consoleInput == NULL) {
+        perror("error: Console input does not exist");
+        return -1;
+    }
+    setvbuf(consoleInput, NULL, _IONBF, 0);
+    return 0;
+}
+
+//helper function for the console input stream; it is unbuffered, so poll()
+//on its descriptor sees every character stdio has not handed out yet
+static FILE* ConsoleInput(void)
+{
+    if (consoleInput == NULL) {
+        consoleInput = stdin;
+        setvbuf(consoleInput, NULL, _IONBF, 0);
+    }
+    return consoleInput;
+}
+
+/*
+ * Buffer one character of console output.
+ */
+void ConsolePutc(unsigned short int c)
+{
+    if (consoleLength == CONSOLE_BUFFER_SIZE) {
+        ConsoleFlush();
+    }
+    consoleBuffer[consoleLength++] = (char) c;
+}
+
+/*
+ * Read one character of console input, 0 at end of input.
+ */
+unsigned short int ConsoleGetc(void)
+{
+    int c = consoleLookahead;
+
+    if (c != EOF) {
+        consoleLookahead = EOF;
+        return (unsigned short int) c;
+    }
+    if (consoleEnded) {
+        return 0;
+    }
+
+    ConsoleFlush();     // show any prompt before blocking
+    c = fgetc(ConsoleInput());
+    if (c == EOF) {
+        consoleEnded = 1;
+        return 0;
+    }
+    return (unsigned short int) c;
+}
+
+/*
+ * Write out any buffered console output.
+ */
+void ConsoleFlush(void)
+{
+    if (consoleLength > 0) {
+        fwrite(consoleBuffer, 1, consoleLength, stdout);
+        fflush(stdout);
+        consoleLength = 0;
+    }
+}
+
+//helper function to check for console input without blocking or consuming it
+static int ConsoleReady(void)
+{
+    struct pollfd input;
+
+    if (consoleLookahead != EOF) {
+        return 1;
+    }
+    if (consoleEnded) {
+        return 0;
+    }
+
+    // nothing waiting on a tty or an idle pipe reads as not ready
+    input.fd = fileno(ConsoleInput());
+    input.events = POLLIN;
+    if (poll(&input, 1, 0) <= 0) {
+        return 0;
+    }
+    consoleLookahead = fgetc(consoleInput);
+    if (consoleLookahead == EOF) {
+        consoleEnded = 1;
+        return 0;
+    }
+    return 1;
+}
+
+//helper function for reads of the console registers
+static unsigned short int ConsoleLoad(MachineState* CPU, unsigned short int address)
+{
+    switch (address) {
+        case OS_KBSR:
+            return ConsoleReady() ? 0x8000 : 0;
+        case OS_KBDR:
+            return ConsoleReady() ? ConsoleGetc() : 0;
+        case OS_ADSR:       // output is buffered, so the display is always ready
+            return 0x8000;
+        default:
+            return CPU->memory[address];
+    }
+}
+
+//helper function for writes to the console registers
+static void ConsoleStore(MachineState* CPU, unsigned short int address, unsigned short int value)
+{
+    if (address == OS_ADDR) {
+        ConsolePutc(value);
+    }
+}
+
+static void TimerFire(MachineState* CPU);
+
+//helper function to make the timer's single pending event the one for timerDeadline
+static void TimerArm(MachineState* CPU)
+{
+    CancelEvent(TimerFire);
+    if (timerInterval == 0) {
+        timerDeadline = NO_EVENT;
+        return;
+    }
+    timerDeadline = CPU->cycle + (unsigned long long) timerInterval * TimerCyclesPerMs;
+    if (ScheduleEvent(timerDeadline, TimerFire) == -1) {
+        fprintf(stderr, "error: device event queue is full, the timer is stopped\n");
+        timerDeadline = NO_EVENT;
+    }
+}
+
+//helper function run when the timer interval has elapsed
+static void TimerFire(MachineState* CPU)
+{
+    timerElapsed = 1;
+    TimerArm(CPU);
+}
+
+//helper function for reads of the timer registers
+static unsigned short int TimerLoad(MachineState* CPU, unsigned short int address)
+{
+    if (address == OS_TSR) {
+        if (timerElapsed) {
+            timerElapsed = 0;   // reading the status acknowledges it
+            return 0x8000;
+        }
+        return 0;
+    }
+    if (address == OS_TIR) {
+        return timerInterval;
+    }
+    return CPU->memory[address];
+}
+
+//helper function for writes to the timer registers
+static void TimerStore(MachineState* CPU, unsigned short int address, unsigned short int value)
+{
+    if (address != OS_TIR) {
+        return;
+    }
+
+    timerInterval = value;
+    timerElapsed = 0;
+    TimerArm(CPU);     // replaces the event of the previous interval
+}
+
+/*
+ * Register the PennSim console and timer devices.
+ */
+void InitDevices(void)
+{
+    RegisterDevice(OS_KBSR, OS_ADDR, ConsoleLoad, ConsoleStore);
+    RegisterDevice(OS_TSR, OS_TIR, TimerLoad, TimerStore);
+}
@@ -0,0 +1,97 @@
+/*
+ * devices.h: Declares the memory-mapped device bus, console, timer and event queue
+ */
+
+#ifndef LC4_DEVICES_H
+#define LC4_DEVICES_H
+
+#include <stdio.h>
+#include "LC4.h"
+
+// PennSim device registers
+#define OS_KBSR 0xFE00      // keyboard status, bit[15] = character ready
+#define OS_KBDR 0xFE02      // keyboard data
+#define OS_ADSR 0xFE04      // display status, bit[15] = ready for output
+#define OS_ADDR 0xFE06      // display data
+#define OS_TSR 0xFE08       // timer status, bit[15] = interval elapsed
+#define OS_TIR 0xFE0A       // timer interval in milliseconds
+#define OS_CORE_ID 0xFE10   // number of the reading core, registered by RunCores
+
+// Capacities of the bus and the event queue
+#define MAX_DEVICES 16
+#define MAX_EVENTS 64
+
+// No event pending
+#define NO_EVENT 0xFFFFFFFFFFFFFFFFULL
+
+typedef unsigned short int (*DeviceLoadFn)(MachineState* CPU, unsigned short int address);
+typedef void (*DeviceStoreFn)(MachineState* CPU, unsigned short int address, unsigned short int value);
+typedef void (*DeviceEventFn)(MachineState* CPU);
+
+// Lowest address handled by a device (0x10000 while none are registered),
+// so LDR/STR need a single compare to skip the bus
+extern unsigned int DeviceRegionStart;
+
+// Cycle of the earliest scheduled event (NO_EVENT if the queue is empty)
+extern unsigned long long NextEventCycle;
+
+// Simulated cycles per millisecond of timer interval
+extern unsigned int TimerCyclesPerMs;
+
+/*
+ * Send loads and stores to addresses start..end (inclusive) to a device.
+ * Returns -1 if the bus is full.
+ */
+int RegisterDevice(unsigned short int start, unsigned short int end, DeviceLoadFn load, DeviceStoreFn store);
+
+/*
+ * Register the PennSim console and timer devices.
+ */
+void InitDevices(void);
+
+/*
+ * Read from a device register (plain memory if no device claims it).
+ */
+unsigned short int DeviceLoad(MachineState* CPU, unsigned short int address);
+
+/*
+ * Tell the device owning address that value was just stored there.
+ */
+void DeviceStore(MachineState* CPU, unsigned short int address, unsigned short int value);
+
+/*
+ * Call fn once the machine reaches the given cycle. Returns -1 if the queue is full.
+ */
+int ScheduleEvent(unsigned long long cycle, DeviceEventFn fn);
+
+/*
+ * Drop every scheduled call of fn.
+ */
+void CancelEvent(DeviceEventFn fn);
+
+/*
+ * Run every event that is due at the current cycle.
+ */
+void ServiceEvents(MachineState* CPU);
+
+/*
+ * Read console input from a file or pipe instead of stdin. Returns -1 on failure.
+ */
+int ConsoleOpenInput(char* filename);
+
+/*
+ * Buffer one character of console output.
+ */
+void ConsolePutc(unsigned short int c);
+
+/*
+ * Read one character of console input, 0 at end of input.
+ */
+unsigned short int ConsoleGetc(void);
+
+/*
+ * Write out any buffered console output.
+ */
+void ConsoleFlush(void);
+
+#endif
@@ -0,0 +1,185 @@
+/*
+ * disasm.c: Defines the disassembly table and the trace disassembly column
+ *
+ * Every instruction word is decoded once, at startup, into its text. Only
+ * branch, JMP and JSR targets depend on the PC, so those entries keep the
+ * offset and the label (or address) is added when the line is written.
+ */
+
+#include "disasm.h"
+#include "loader.h"
+
+int DisasmColumn = 0;
+
+static DisasmEntry* table = NULL;
+static const char** labels = NULL;      // symbol name at each address, if any
+
+//helper function to fill in one entry
+static void Decode(unsigned short int inst, DisasmEntry* entry)
+{
+    static const char* conditions[8] = { "NOP", "BRp", "BRz", "BRzp", "BRn", "BRnp", "BRnz", "BRnzp" };
+    static const char* arithmetic[4] = { "ADD", "MUL", "SUB", "DIV" };
+    static const char* compares[4] = { "CMP", "CMPU", "CMPI", "CMPIU" };
+    static const char* logical[4] = { "AND", "NOT", "OR", "XOR" };
+    static const char* shifts[4] = { "SLL", "SRA", "SRL", "MOD" };
+    unsigned int rd = inst >> 9 & 0x7;
+    unsigned int rs = inst >> 6 & 0x7;
+    unsigned int rt = inst & 0x7;
+    unsigned int sub = inst >> 3 & 0x7;
+    char* text = entry->text;
+    int length;
+
+    entry->target = DISASM_TARGET_NONE;
+    entry->offset = 0;
+
+    switch (inst >> 12) {
+        case 0x0:
+            if (rd == 0) {
+                length = sprintf(text, "NOP");
+            } else {
+                length = sprintf(text, "%s ", conditions[rd]);
+                entry->target = DISASM_TARGET_RELATIVE;
+                entry->offset = Sext(inst & 0x1FF, 9);
+            }
+            break;
+        case 0x1:
+            if (inst & 0x20) {
+                length = sprintf(text, "ADD R%u, R%u, #%d", rd, rs, Sext(inst & 0x1F, 5));
+            } else if (sub < 4) {
+                length = sprintf(text, "%s R%u, R%u, R%u", arithmetic[sub], rd, rs, rt);
+            } else {
+                length = sprintf(text, ".FILL x%04X", inst);
+            }
+            break;
+        case 0x2:
+            if (inst & 0x100) {
+                length = sprintf(text, "%s R%u, #%d", compares[inst >> 7 & 0x3], rd,
+                                 inst & 0x80 ? inst & 0x7F : Sext(inst & 0x7F, 7));
+            } else {
+                length = sprintf(text, "%s R%u, R%u", compares[inst >> 7 & 0x3], rd, rt);
+            }
+            break;
+        case 0x4:
+            if (inst & 0x800) {
+                length = sprintf(text, "JSR ");
+                entry->target = DISASM_TARGET_JSR;
+                entry->offset = Sext(inst & 0x7FF, 11) << 4;     // as JSROp: signed, so bit 10 sets bit 15
+            } else {
+                length = sprintf(text, "JSRR R%u", rs);
+            }
+            break;
+        case 0x5:
+            if (inst & 0x20) {
+                length = sprintf(text, "AND R%u, R%u, #%d", rd, rs, Sext(inst & 0x1F, 5));
+            } else if (sub == 1) {
+                length = sprintf(text, "NOT R%u, R%u", rd, rs);
+            } else if (sub < 4) {
+                length = sprintf(text, "%s R%u, R%u, R%u", logical[sub], rd, rs, rt);
+            } else {
+                length = sprintf(text, ".FILL x%04X", inst);
+            }
+            break;
+        case 0x6:
+            length = sprintf(text, "LDR R%u, R%u, #%d", rd, rs, Sext(inst & 0x3F, 6));
+            break;
+        case 0x7:
+            length = sprintf(text, "STR R%u, R%u, #%d", rd, rs, Sext(inst & 0x3F, 6));
+            break;
+        case 0x8:
+            length = sprintf(text, "RTI");
+            break;
+        case 0x9:
+            length = sprintf(text, "CONST R%u, #%d", rd, Sext(inst & 0x1FF, 9));
+            break;
+        case 0xA:
+            if ((inst >> 4 & 0x3) == 3) {
+                length = sprintf(text, "MOD R%u, R%u, R%u", rd, rs, rt);
+            } else {
+                length = sprintf(text, "%s R%u, R%u, #%u", shifts[inst >> 4 & 0x3], rd, rs, inst & 0xF);
+            }
+            break;
+        case 0xC:
+            if (inst & 0x800) {
+                length = sprintf(text, "JMP ");
+                entry->target = DISASM_TARGET_RELATIVE;
+                entry->offset = Sext(inst & 0x7FF, 11);
+            } else {
+                length = sprintf(text, "JMPR R%u", rs);
+            }
+            break;
+        case 0xD:
+            length = sprintf(text, "HICONST R%u, #%u", rd, inst & 0xFF);
+            break;
+        case 0xF:
+            length = sprintf(text, "TRAP x%02X", inst & 0xFF);
+            break;
+        default:
+            length = sprintf(text, ".FILL x%04X", inst);
+            break;
+    }
+    entry->length = length;
+}
+
+/*
+ * Build the table for all 65536 instruction words and the label of every
+ * symbol address known to the loader. Returns -1 if out of memory.
+ */
+int DisasmInit(void)
+{
+    unsigned short int address;
+    unsigned int i;
+    const char* name;
+
+    table = malloc(65536 * sizeof(DisasmEntry));
+    labels = malloc(65536 * sizeof(char*));
+    if (table == NULL || labels == NULL) {
+        return -1;
+    }
+
+    for (i = 0; i <= 0xFFFF; i++) {
+        Decode(i, &table[i]);
+        labels[i] = NULL;
+    }
+
+    // every symbol labels its own address, even where two files share a name
+    for (i = 0; (name = SymbolAt(i, &address)) != NULL; i++) {
+        if (labels[address] == NULL) {
+            labels[address] = name;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Write the disassembly of the instruction inst at pc, preceded by a space.
+ */
+void DisasmWrite(FILE* output, unsigned short int pc, unsigned short int inst)
+{
+    const DisasmEntry* entry = &table[inst];
+    unsigned short int target;
+
+    fputc(' ', output);
+    fwrite(entry->text, 1, entry->length, output);
+    if (entry->target == DISASM_TARGET_NONE) {
+        return;
+    }
+
+    if (entry->target == DISASM_TARGET_RELATIVE) {
+        target = pc + 1 + entry->offset;
+    } else {
+        target = (pc & 0x8000) | entry->offset;
+    }
+    if (labels[target] != NULL) {
+        fputs(labels[target], output);
+    } else {
+        fprintf(output, "x%04X", target);
+    }
+}
+
+/*
+ * Label the disassembly column uses for address, or NULL.
+ */
+const char* DisasmLabel(unsigned short int address)
+{
+    return labels != NULL ? labels[address] : NULL;
+}
@@ -0,0 +1,45 @@
+/*
+ * disasm.h: Declares the disassembly table and the trace disassembly column
+ */
+
+#ifndef LC4_DISASM_H
+#define LC4_DISASM_H
+
+#include <stdio.h>
+#include "LC4.h"
+
+// Longest disassembly of an instruction without its target
+#define DISASM_TEXT_MAX 24
+
+// How the target of a control transfer is found from the PC
+#define DISASM_TARGET_NONE 0
+#define DISASM_TARGET_RELATIVE 1    // PC + 1 + offset (BR, JMP)
+#define DISASM_TARGET_JSR 2         // (PC & x8000) | offset (JSR)
+
+typedef struct {
+    char text[DISASM_TEXT_MAX];     // mnemonic and operands, without the target
+    unsigned char length;
+    unsigned char target;
+    short int offset;
+} DisasmEntry;
+
+// If set, WriteOut appends the disassembly of each instruction to its line
+extern int DisasmColumn;
+
+/*
+ * Build the table for all 65536 instruction words and the label of every
+ * symbol address known to the loader. Returns -1 if out of memory.
+ */
+int DisasmInit(void);
+
+/*
+ * Write the disassembly of the instruction inst at pc, preceded by a space.
+ */
+void DisasmWrite(FILE* output, unsigned short int pc, unsigned short int inst);
+
+/*
+ * Label the disassembly column uses for address, or NULL.
+ */
+const char* DisasmLabel(unsigned short int address);
+
+#endif
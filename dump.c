@@ -0,0 +1,167 @@
+/*
+ * dump.c: Defines the final state and memory dump
+ *
+ * Memory is scanned in blocks of 8 words (one SSE2 register), four blocks at
+ * a time, so the all-zero stretches that make up most of a memory image cost
+ * one compare per 32 words. Runs of non-zero blocks become the ranges of the
+ * binary form; the text form picks the non-zero words out of the same runs.
+ */
+
+#include "dump.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define BLOCK_WORDS 8
+#define BLOCKS (65536 / BLOCK_WORDS)
+#define MAX_RANGES (BLOCKS / 2)
+#define TEXT_LINE "address: 00000 contents: 0x0000\n"
+#define TEXT_LINE_LENGTH (sizeof(TEXT_LINE) - 1)
+#define TEXT_BUFFER_LINES 2048
+
+//helper function to flag each block of memory holding a non-zero word
+static void ScanMemory(const unsigned short int* memory, unsigned char* nonzero)
+{
+    unsigned short int any;
+    unsigned int b = 0;
+    unsigned int w;
+
+#ifdef __SSE2__
+    __m128i zero = _mm_setzero_si128();
+    __m128i block0, block1, block2, block3;
+
+    for (; b + 4 <= BLOCKS; b += 4) {
+        block0 = _mm_loadu_si128((const __m128i*) (memory + b * BLOCK_WORDS));
+        block1 = _mm_loadu_si128((const __m128i*) (memory + (b + 1) * BLOCK_WORDS));
+        block2 = _mm_loadu_si128((const __m128i*) (memory + (b + 2) * BLOCK_WORDS));
+        block3 = _mm_loadu_si128((const __m128i*) (memory + (b + 3) * BLOCK_WORDS));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_or_si128(_mm_or_si128(block0, block1),
+                                                           _mm_or_si128(block2, block3)), zero)) == 0xFFFF) {
+            nonzero[b] = nonzero[b + 1] = nonzero[b + 2] = nonzero[b + 3] = 0;
+            continue;
+        }
+        nonzero[b] = _mm_movemask_epi8(_mm_cmpeq_epi16(block0, zero)) != 0xFFFF;
+        nonzero[b + 1] = _mm_movemask_epi8(_mm_cmpeq_epi16(block1, zero)) != 0xFFFF;
+        nonzero[b + 2] = _mm_movemask_epi8(_mm_cmpeq_epi16(block2, zero)) != 0xFFFF;
+        nonzero[b + 3] = _mm_movemask_epi8(_mm_cmpeq_epi16(block3, zero)) != 0xFFFF;
+    }
+#endif
+
+    // without SSE2, one word at a time (which compilers vectorize anyway)
+    for (; b < BLOCKS; b++) {
+        any = 0;
+        for (w = 0; w < BLOCK_WORDS; w++) {
+            any |= memory[b * BLOCK_WORDS + w];
+        }
+        nonzero[b] = any != 0;
+    }
+}
+
+//helper function to turn the flagged blocks into ranges; returns how many
+static int FindRanges(const unsigned char* nonzero, DumpRange* ranges)
+{
+    int numRanges = 0;
+    int b = 0;
+    int start;
+
+    while (b < BLOCKS) {
+        if (!nonzero[b]) {
+            b++;
+            continue;
+        }
+        start = b;
+        while (b < BLOCKS && nonzero[b]) {
+            b++;
+        }
+        ranges[numRanges].address = start * BLOCK_WORDS;
+        ranges[numRanges].length = (b - start) * BLOCK_WORDS - 1;
+        numRanges++;
+    }
+    return numRanges;
+}
+
+//helper function to write number into digits characters ending at end
+static void FormatNumber(char* end, unsigned int number, int digits, unsigned int base)
+{
+    static const char hex[] = "0123456789ABCDEF";
+
+    while (digits-- > 0) {
+        *--end = hex[number % base];
+        number /= base;
+    }
+}
+
+//helper function for the text form of the memory
+static int WriteText(const unsigned short int* memory, const DumpRange* ranges, int numRanges, FILE* output)
+{
+    char buffer[TEXT_BUFFER_LINES * TEXT_LINE_LENGTH];
+    char* line = buffer;
+    unsigned int address, end;
+    int r;
+
+    for (r = 0; r < numRanges; r++) {
+        end = ranges[r].address + ranges[r].length;
+        for (address = ranges[r].address; address <= end; address++) {
+            if (memory[address] == 0) {
+                continue;
+            }
+            memcpy(line, TEXT_LINE, TEXT_LINE_LENGTH);
+            FormatNumber(line + 14, address, 5, 10);
+            FormatNumber(line + 31, memory[address], 4, 16);
+            line += TEXT_LINE_LENGTH;
+            if (line == buffer + sizeof(buffer)) {
+                if (fwrite(buffer, 1, sizeof(buffer), output) != sizeof(buffer)) {
+                    return -1;
+                }
+                line = buffer;
+            }
+        }
+    }
+    return fwrite(buffer, 1, line - buffer, output) == (size_t) (line - buffer) ? 0 : -1;
+}
+
+/*
+ * Write the registers, PSR and final status of CPU and every non-zero word
+ * of its memory to output. The text form is PrintState, a status line and
+ * one "address: %05d contents: 0x%04X" line per word; the binary form is
+ * described above. Returns -1 if the writes fail.
+ */
+int WriteDump(MachineState* CPU, int status, int format, FILE* output)
+{
+    unsigned char nonzero[BLOCKS];
+    DumpRange ranges[MAX_RANGES];
+    DumpHeader header;
+    int numRanges;
+    int r;
+
+    ScanMemory(CPU->memory, nonzero);
+    numRanges = FindRanges(nonzero, ranges);
+
+    if (format == DUMP_TEXT) {
+        PrintState(CPU, output);
+        fprintf(output, "status %d\n", status);
+        return WriteText(CPU->memory, ranges, numRanges, output);
+    }
+
+    memset(&header, 0, sizeof(header));
+    header.status = status;
+    header.PC = CPU->PC;
+    header.PSR = CPU->PSR;
+    memcpy(header.R, CPU->R, sizeof(header.R));
+    header.NZPVal = CPU->NZPVal;
+    header.numRanges = numRanges;
+    header.cycle = CPU->cycle;
+    if (fwrite(DUMP_MAGIC, 1, DUMP_MAGIC_LENGTH, output) != DUMP_MAGIC_LENGTH
+        || fwrite(&header, sizeof(header), 1, output) != 1) {
+        return -1;
+    }
+    for (r = 0; r < numRanges; r++) {
+        if (fwrite(&ranges[r], sizeof(DumpRange), 1, output) != 1
+            || fwrite(&CPU->memory[ranges[r].address], sizeof(unsigned short int), ranges[r].length + 1, output)
+               != (size_t) ranges[r].length + 1) {
+            return -1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,47 @@
+/*
+ * dump.h: Declares the final state and memory dump
+ */
+
+#ifndef LC4_DUMP_H
+#define LC4_DUMP_H
+
+#include <stdio.h>
+#include "LC4.h"
+
+// How WriteDump writes the memory
+#define DUMP_TEXT 0
+#define DUMP_BINARY 1
+
+// A binary dump starts with this 8 byte tag and a DumpHeader, followed by
+// numRanges ranges, each a DumpRange and then its words (host byte order).
+// The header is written as the raw host struct, padding included: on the
+// usual ABIs there are 4 padding bytes before cycle and the header is 40
+// bytes, so readers must use this struct or its offsets, not a packed layout
+#define DUMP_MAGIC "LC4DMP01"
+#define DUMP_MAGIC_LENGTH 8
+
+typedef struct {
+    int status;                     // final UpdateMachineState code
+    unsigned short int PC;
+    unsigned short int PSR;
+    unsigned short int R[8];
+    unsigned short int NZPVal;
+    unsigned short int numRanges;
+    unsigned long long cycle;
+} DumpHeader;
+
+// Consecutive words starting at address, not all of them non-zero
+typedef struct {
+    unsigned short int address;
+    unsigned short int length;      // words, minus 1
+} DumpRange;
+
+/*
+ * Write the registers, PSR and final status of CPU and every non-zero word
+ * of its memory to output. The text form is PrintState, a status line and
+ * one "address: %05d contents: 0x%04X" line per word; the binary form is
+ * described above. Returns -1 if the writes fail.
+ */
+int WriteDump(MachineState* CPU, int status, int format, FILE* output);
+
+#endif
@@ -0,0 +1,288 @@
+/*
+ * fastcore.c: Defines the table-driven interpreter core
+ */
+
+#include "fastcore.h"
+#include "devices.h"
+#include "fusion.h"
+
+//helper function to finish an instruction writing value to Rd, as the
+//arithmetic, logical and shift handlers do
+static void WriteRd(MachineState* CPU, const DecodedInsn* insn, unsigned short int value, FILE* output)
+{
+    CPU->regFile_WE = 1;
+    CPU->DATA_WE = 0;
+    CPU->dmemAddr = 0;
+    CPU->dmemValue = 0;
+
+    CPU->regInputVal = value;
+    CPU->R[insn->rd] = value;
+    SetNZP(CPU, value);
+
+    CPU->rdMux_CTL = insn->rd;
+    WriteOut(CPU, output);
+    CPU->rdMux_CTL = 0;
+    CPU->rsMux_CTL = 0;
+
+    CPU->PC += 1;
+}
+
+//helper function to finish a compare with the given difference
+static void Compare(MachineState* CPU, unsigned short int difference, FILE* output)
+{
+    CPU->rdMux_CTL = 0;
+    CPU->regFile_WE = 0;
+    CPU->DATA_WE = 0;
+    CPU->dmemAddr = 0;
+    CPU->dmemValue = 0;
+
+    SetNZP(CPU, difference);
+    CPU->regInputVal = 0;
+    WriteOut(CPU, output);
+
+    CPU->rsMux_CTL = 2;
+    CPU->rtMux_CTL = 0;
+    CPU->PC += 1;
+}
+
+//helper function to set the signals of a branch and write its line
+static void BranchSignals(MachineState* CPU, FILE* output)
+{
+    CPU->rsMux_CTL = 0;
+    CPU->rdMux_CTL = 0;
+    CPU->rtMux_CTL = 0;
+    CPU->regFile_WE = 0;
+    CPU->NZP_WE = 0;
+    CPU->DATA_WE = 0;
+    CPU->dmemAddr = 0;
+    CPU->dmemValue = 0;
+    CPU->regInputVal = 0;
+    WriteOut(CPU, output);
+}
+
+void FastNothing(MachineState* CPU, const DecodedInsn* insn, FILE* output)
+{
+}
+
+void FastBranchNever(MachineState* CPU, const DecodedInsn* insn, FILE* output)
+{
+    BranchSignals(CPU, output);
+    CPU->PC += 1;
+}
+
+void FastBranchAlways(MachineState* CPU, const DecodedInsn* insn, FILE* output)
+{
+    BranchSignals(CPU, output);
+    CPU->PC += insn->imm + 1;
+}
+
+void FastBranch(MachineState* CPU, const DecodedInsn* insn, FILE* output)
+{
+    BranchSignals(CPU, output);
+    // NZPVal is 0 or exactly one of N, Z, P
+    if (CPU->NZPVal & insn->rd) {
+        CPU->PC += insn->imm;
+    }
+    CPU->PC += 1;
+}
+
+void FastADD(MachineState* CPU, const DecodedInsn* insn, FILE* output)
+{
+    CPU->rtMux_CTL = 0;
+    WriteRd(CPU, insn, CPU->R[insn->rs] + CPU->R[insn->rt], output);
+}
+
+void FastMUL(MachineState* CPU, const DecodedInsn* insn, FILE* output)
+{
+    CPU->rtMux_CTL = 0;
+    WriteRd(CPU, insn, CPU->R[insn->rs] * CPU->R[insn->rt], output);
+}
+
+void FastSUB(MachineState* CPU, const DecodedInsn* insn, FILE* output)
+{
+    CPU->rtMux_CTL = 0;
+    WriteRd(CPU, insn, CPU->R[insn->rs] - CPU->R[insn->rt], output);
+}
+
+void FastDIV(MachineState* CPU, const DecodedInsn* insn, FILE* output)
+{
+    CPU->rtMux_CTL = 0;
+    WriteRd(CPU, insn, CPU->R[insn->rs] / CPU->R[insn->rt], output);
+}
+
+void FastADDI(MachineState* CPU, const DecodedInsn* insn, FILE* output)
+{
+    CPU->rtMux_CTL = 0;
+    WriteRd(CPU, insn, CPU->R[insn->rs] + insn->imm, output);
+}
+
+void FastCMP(MachineState* CPU, const DecodedInsn* insn, FILE* output)
+{
+    Compare(CPU, (short int) CPU->R[insn->rs] - (short int) CPU->R[insn->rt], output);
+}
+
+void FastCMPU(MachineState* CPU, const DecodedInsn* insn, FILE* output)
+{
+    Compare(CPU, CPU->R[insn->rs] - CPU->R[insn->rt], output);
+}
+
+void FastCMPI(MachineState* CPU, const DecodedInsn* insn, FILE* output)
+{
+    Compare(CPU, CPU->R[insn->rs] - insn->imm, output);
+}
+
+void FastCMPIU(MachineState* CPU, const DecodedInsn* insn, FILE* output)
+{
+    Compare(CPU, CPU->R[insn->rs] - insn->imm, output);
+}
+
+void FastAND(MachineState* CPU, const DecodedInsn* insn, FILE* output)
+{
+    CPU->rtMux_CTL = 0;
+    WriteRd(CPU, insn, CPU->R[insn->rs] & CPU->R[insn->rt], output);
+}
+
+void FastNOT(MachineState* CPU, const DecodedInsn* insn, FILE* output)
+{
+    CPU->rtMux_CTL = 0;
+    WriteRd(CPU, insn, ~CPU->R[insn->rs], output);
+}
+
+void FastOR(MachineState* CPU, const DecodedInsn* insn, FILE* output)
+{
+    CPU->rtMux_CTL = 0;
+    WriteRd(CPU, insn, CPU->R[insn->rs] | CPU->R[insn->rt], output);
+}
+
+void FastXOR(MachineState* CPU, const DecodedInsn* insn, FILE* output)
+{
+    CPU->rtMux_CTL = 0;
+    WriteRd(CPU, insn, CPU->R[insn->rs] ^ CPU->R[insn->rt], output);
+}
+
+void FastANDI(MachineState* CPU, const DecodedInsn* insn, FILE* output)
+{
+    CPU->rtMux_CTL = 0;
+    WriteRd(CPU, insn, CPU->R[insn->rs] & insn->imm, output);
+}
+
+void FastCONST(MachineState* CPU, const DecodedInsn* insn, FILE* output)
+{
+    CPU->rtMux_CTL = 0;
+    WriteRd(CPU, insn, insn->imm, output);
+}
+
+void FastHICONST(MachineState* CPU, const DecodedInsn* insn, FILE* output)
+{
+    CPU->rtMux_CTL = 0;
+    WriteRd(CPU, insn, (CPU->R[insn->rd] & 0xFF) | insn->imm, output);
+    CPU->rsMux_CTL = 2;
+}
+
+void FastSLL(MachineState* CPU, const DecodedInsn* insn, FILE* output)
+{
+    CPU->rtMux_CTL = 0;
+    WriteRd(CPU, insn, CPU->R[insn->rs] << insn->imm, output);
+}
+
+void FastSRA(MachineState* CPU, const DecodedInsn* insn, FILE* output)
+{
+    CPU->rtMux_CTL = 0;
+    WriteRd(CPU, insn, (short int) CPU->R[insn->rs] >> insn->imm, output);
+}
+
+void FastSRL(MachineState* CPU, const DecodedInsn* insn, FILE* output)
+{
+    CPU->rtMux_CTL = 0;
+    WriteRd(CPU, insn, CPU->R[insn->rs] >> insn->imm, output);
+}
+
+void FastMOD(MachineState* CPU, const DecodedInsn* insn, FILE* output)
+{
+    // MOD leaves Rt selected, unlike the shifts
+    CPU->rtMux_CTL = insn->rt;
+    WriteRd(CPU, insn, CPU->R[insn->rs] % CPU->R[insn->rt], output);
+}
+
+void FastJSR(MachineState* CPU, const DecodedInsn* insn, FILE* output)
+{
+    JSROp(CPU, output);
+}
+
+void FastLDR(MachineState* CPU, const DecodedInsn* insn, FILE* output)
+{
+    LDROp(CPU, output);
+}
+
+void FastSTR(MachineState* CPU, const DecodedInsn* insn, FILE* output)
+{
+    STROp(CPU, output);
+}
+
+void FastRTI(MachineState* CPU, const DecodedInsn* insn, FILE* output)
+{
+    RTIOp(CPU, output);
+}
+
+void FastJMP(MachineState* CPU, const DecodedInsn* insn, FILE* output)
+{
+    JumpOp(CPU, output);
+}
+
+void FastTRAP(MachineState* CPU, const DecodedInsn* insn, FILE* output)
+{
+    TrapOp(CPU, output);
+}
+
+/*
+ * This function executes one LC4 datapath cycle through InsnTable. It writes
+ * the same trace and leaves the same machine state as UpdateMachineState.
+ */
+int UpdateMachineStateFast(MachineState* CPU, FILE* output)
+{
+    unsigned short int pc = CPU->PC;
+    const DecodedInsn* insn = &InsnTable[CPU->memory[pc]];
+    unsigned int fused;
+    int errorCode;
+
+    // hooks and profiling live on the ordinary path
+    if (SimHooks) {
+        return UpdateMachineState(CPU, output);
+    }
+
+    //exit address check
+    if (pc == 0x80FF) {
+        return 4;
+    }
+
+    // executing data as code; only loads and stores need the rest of CheckErrors
+    if ((pc >= 0x2000 && pc < 0x8000) || pc >= 0xA000) {
+        return 1;
+    }
+    if (insn->flags & INSN_MEMORY) {
+        errorCode = CheckErrors(CPU);
+        if (errorCode > 0) {
+            return errorCode;
+        }
+    }
+
+    // the same idioms the ordinary path fuses, under the same event limit
+    if (FusionEnabled) {
+        fused = ExecuteFused(CPU, output, NextEventCycle > CPU->cycle ? NextEventCycle - CPU->cycle : 0);
+        if (fused > 0) {
+            CPU->cycle += fused;
+            if (CPU->cycle >= NextEventCycle) {
+                ServiceEvents(CPU);
+            }
+            return 0;
+        }
+    }
+
+    insn->run(CPU, insn, output);
+    CPU->cycle++;
+
+    if (CPU->cycle >= NextEventCycle) {
+        ServiceEvents(CPU);
+    }
+    return 0;
+}
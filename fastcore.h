@@ -0,0 +1,74 @@
+/*
+ * fastcore.h: Declares the table-driven interpreter core
+ *
+ * Every 16-bit instruction word indexes a pre-decoded entry in InsnTable
+ * (generated at build time by gentable) holding the handler specialized for
+ * that operation together with its register numbers and immediate, so no
+ * fields are decoded while the program runs.
+ */
+
+#ifndef LC4_FASTCORE_H
+#define LC4_FASTCORE_H
+
+#include <stdio.h>
+#include "LC4.h"
+
+// flags of a decoded instruction
+#define INSN_MEMORY 0x1     // LDR/STR: CheckErrors must look at the data address
+
+typedef struct DecodedInsn DecodedInsn;
+
+typedef void (*FastHandler)(MachineState* CPU, const DecodedInsn* insn, FILE* output);
+
+struct DecodedInsn {
+    FastHandler run;
+    unsigned char rd;       // Rd (condition codes for branches)
+    unsigned char rs;       // Rs (the first register of a compare)
+    unsigned char rt;       // Rt
+    unsigned char flags;
+    short int imm;          // sign or zero extended immediate, already shifted for HICONST
+};
+
+extern const DecodedInsn InsnTable[65536];
+
+/*
+ * This function executes one LC4 datapath cycle through InsnTable. It writes
+ * the same trace and leaves the same machine state as UpdateMachineState.
+ */
+int UpdateMachineStateFast(MachineState* CPU, FILE* output);
+
+// Handlers referenced by InsnTable
+void FastNothing(MachineState* CPU, const DecodedInsn* insn, FILE* output);
+void FastBranchNever(MachineState* CPU, const DecodedInsn* insn, FILE* output);
+void FastBranchAlways(MachineState* CPU, const DecodedInsn* insn, FILE* output);
+void FastBranch(MachineState* CPU, const DecodedInsn* insn, FILE* output);
+void FastADD(MachineState* CPU, const DecodedInsn* insn, FILE* output);
+void FastMUL(MachineState* CPU, const DecodedInsn* insn, FILE* output);
+void FastSUB(MachineState* CPU, const DecodedInsn* insn, FILE* output);
+void FastDIV(MachineState* CPU, const DecodedInsn* insn, FILE* output);
+void FastADDI(MachineState* CPU, const DecodedInsn* insn, FILE* output);
+void FastCMP(MachineState* CPU, const DecodedInsn* insn, FILE* output);
+void FastCMPU(MachineState* CPU, const DecodedInsn* insn, FILE* output);
+void FastCMPI(MachineState* CPU, const DecodedInsn* insn, FILE* output);
+void FastCMPIU(MachineState* CPU, const DecodedInsn* insn, FILE* output);
+void FastAND(MachineState* CPU, const DecodedInsn* insn, FILE* output);
+void FastNOT(MachineState* CPU, const DecodedInsn* insn, FILE* output);
+void FastOR(MachineState* CPU, const DecodedInsn* insn, FILE* output);
+void FastXOR(MachineState* CPU, const DecodedInsn* insn, FILE* output);
+void FastANDI(MachineState* CPU, const DecodedInsn* insn, FILE* output);
+void FastCONST(MachineState* CPU, const DecodedInsn* insn, FILE* output);
+void FastHICONST(MachineState* CPU, const DecodedInsn* insn, FILE* output);
+void FastSLL(MachineState* CPU, const DecodedInsn* insn, FILE* output);
+void FastSRA(MachineState* CPU, const DecodedInsn* insn, FILE* output);
+void FastSRL(MachineState* CPU, const DecodedInsn* insn, FILE* output);
+void FastMOD(MachineState* CPU, const DecodedInsn* insn, FILE* output);
+
+// Rare or irregular encodings go to the ordinary handlers
+void FastJSR(MachineState* CPU, const DecodedInsn* insn, FILE* output);
+void FastLDR(MachineState* CPU, const DecodedInsn* insn, FILE* output);
+void FastSTR(MachineState* CPU, const DecodedInsn* insn, FILE* output);
+void FastRTI(MachineState* CPU, const DecodedInsn* insn, FILE* output);
+void FastJMP(MachineState* CPU, const DecodedInsn* insn, FILE* output);
+void FastTRAP(MachineState* CPU, const DecodedInsn* insn, FILE* output);
+
+#endif
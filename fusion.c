@@ -0,0 +1,202 @@
+/*
+ * fusion.c: Defines macro-op fusion of common LC4 instruction idioms
+ */
+
+#include <limits.h>
+#include "fusion.h"
+
+#define INSN_RD(I) ((I) >> 9 & 0x7)     // Rd (or Rs of a compare)
+#define INSN_RS(I) ((I) >> 6 & 0x7)     // Rs
+#define INSN_RT(I) ((I) & 0x7)          // Rt
+
+#define COUNTDOWN_BRP 0x03FE            // BRp back to the instruction before it
+
+int FusionEnabled = 0;
+__thread unsigned long long FusionStopCycle = ULLONG_MAX;
+
+//helper function to finish a branch whose PC is in CPU->PC, as BranchOp would
+static void TakeBranch(MachineState* CPU, unsigned short int inst)
+{
+    unsigned short int cc = INSN_RD(inst);
+
+    CPU->rsMux_CTL = 0;
+    CPU->rdMux_CTL = 0;
+    CPU->rtMux_CTL = 0;
+    CPU->regFile_WE = 0;
+    CPU->NZP_WE = 0;
+    CPU->DATA_WE = 0;
+    CPU->dmemAddr = 0;
+    CPU->dmemValue = 0;
+    CPU->regInputVal = 0;
+
+    // NZPVal is exactly one of N, Z or P after a compare or an ADD
+    if (cc == 7 || (CPU->NZPVal & cc)) {
+        CPU->PC += Sext(inst & 0x1FF, 9);
+    }
+    CPU->PC += 1;
+}
+
+//helper function for CONST Rd, IMM9 followed by HICONST Rd, UIMM8
+static unsigned int FuseConstHiConst(MachineState* CPU, FILE* output, unsigned short int first, unsigned short int second)
+{
+    if (output != NULL) {
+        ConstOp(CPU, output);
+        HiConstOp(CPU, output);
+        return 2;
+    }
+
+    CPU->rsMux_CTL = 2;
+    CPU->rdMux_CTL = 0;
+    CPU->rtMux_CTL = 0;
+    CPU->regFile_WE = 1;
+    CPU->DATA_WE = 0;
+    CPU->dmemAddr = 0;
+    CPU->dmemValue = 0;
+
+    // Rd = (sext(IMM9) & 0xFF) | (UIMM8 << 8)
+    CPU->regInputVal = (Sext(first & 0x1FF, 9) & 0xFF) | ((second & 0xFF) << 8);
+    CPU->R[INSN_RD(first)] = CPU->regInputVal;
+    SetNZP(CPU, CPU->regInputVal);
+
+    CPU->PC += 2;
+    return 2;
+}
+
+//helper function for CMP/CMPU/CMPI/CMPIU followed by a branch
+static unsigned int FuseCompareBranch(MachineState* CPU, FILE* output, unsigned short int first, unsigned short int second)
+{
+    unsigned short int rs = INSN_RD(first);
+    unsigned short int imm7 = first & 0x7F;
+    unsigned short int result = 0;
+
+    if (output != NULL) {
+        ComparativeOp(CPU, output);
+        BranchOp(CPU, output);
+        return 2;
+    }
+
+    // same arithmetic as ComparativeOp
+    switch (first >> 7 & 0x3) {
+        case 0:             // CMP Rs Rt
+            result = Sext(CPU->R[rs], 16) - Sext(CPU->R[INSN_RT(first)], 16);
+            break;
+        case 1:             // CMPU Rs Rt
+            result = CPU->R[rs] - CPU->R[INSN_RT(first)];
+            break;
+        case 2:             // CMPI Rs IMM7
+            result = CPU->R[rs] - Sext(imm7, 7);
+            break;
+        case 3:             // CMPIU Rs UIMM7
+            result = CPU->R[rs] - imm7;
+            break;
+    }
+    SetNZP(CPU, result);
+
+    CPU->PC += 1;
+    TakeBranch(CPU, second);
+    return 2;
+}
+
+//helper function for ADD Rd, Rs, IMM5 followed by a branch
+static unsigned int FuseAddBranch(MachineState* CPU, FILE* output, unsigned short int first, unsigned short int second)
+{
+    unsigned short int result;
+
+    if (output != NULL) {
+        ArithmeticOp(CPU, output);
+        BranchOp(CPU, output);
+        return 2;
+    }
+
+    result = CPU->R[INSN_RS(first)] + Sext(first & 0x1F, 5);
+    CPU->R[INSN_RD(first)] = result;
+    SetNZP(CPU, result);
+
+    CPU->PC += 1;
+    TakeBranch(CPU, second);
+    return 2;
+}
+
+//helper function for the delay loop ADD Rx, Rx, #-1 / BRp back to the ADD
+static unsigned int FuseCountdown(MachineState* CPU, FILE* output, unsigned short int first, unsigned short int second, unsigned long long limit)
+{
+    unsigned short int rx = INSN_RD(first);
+    short int afterFirst = CPU->R[rx] - 1;
+    unsigned long long iterations;
+    unsigned long long i;
+
+    // the loop keeps going while the counter stays positive
+    iterations = 1 + (afterFirst > 0 ? afterFirst : 0);
+    if (iterations > limit / 2) {
+        iterations = limit / 2;     // stop at the head of the loop
+    }
+
+    if (output != NULL) {
+        for (i = 0; i < iterations; i++) {
+            ArithmeticOp(CPU, output);
+            BranchOp(CPU, output);
+        }
+        return 2 * iterations;
+    }
+
+    CPU->R[rx] -= iterations;
+    SetNZP(CPU, CPU->R[rx]);
+
+    CPU->PC += 1;
+    TakeBranch(CPU, second);
+    return 2 * iterations;
+}
+
+/*
+ * If the instructions at PC form a fusible idiom (CONST/HICONST on one
+ * register, a compare or immediate ADD followed by a branch, or a tight
+ * ADD Rx, Rx, #-1 / BRp countdown loop), execute it as one operation, running
+ * at most limit instructions and never past FusionStopCycle. Returns the number of instructions executed,
+ * 0 if nothing was fused. With a trace open, every instruction of the idiom
+ * still gets its own line.
+ */
+unsigned int ExecuteFused(MachineState* CPU, FILE* output, unsigned long long limit)
+{
+    unsigned short int pc = CPU->PC;
+    unsigned short int first = CPU->memory[pc];
+    unsigned short int second;
+
+    if (CPU->cycle >= FusionStopCycle) {
+        return 0;
+    }
+    if (FusionStopCycle - CPU->cycle < limit) {
+        limit = FusionStopCycle - CPU->cycle;
+    }
+
+    // the second instruction has to pass the same CheckErrors tests as the first,
+    // which holds as long as both sit in the same 8K region
+    if (limit < 2 || ((pc + 1) & 0x1FFF) == 0 || pc + 1 == 0x80FF) {
+        return 0;
+    }
+    second = CPU->memory[pc + 1];
+
+    switch (first >> 12) {
+        case 0x9:       // CONST
+            if (second >> 12 == 0xD && INSN_RD(first) == INSN_RD(second)) {
+                return FuseConstHiConst(CPU, output, first, second);
+            }
+            break;
+        case 0x2:       // compare
+            if (second >> 12 == 0x0) {
+                return FuseCompareBranch(CPU, output, first, second);
+            }
+            break;
+        case 0x1:       // arithmetic
+            if ((first & 0x20) == 0 || second >> 12 != 0x0) {
+                break;
+            }
+            if ((first & 0x1F) == 0x1F && INSN_RD(first) == INSN_RS(first) && second == COUNTDOWN_BRP) {
+                return FuseCountdown(CPU, output, first, second, limit);
+            }
+            return FuseAddBranch(CPU, output, first, second);
+        default:
+            break;
+    }
+
+    return 0;
+}
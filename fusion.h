@@ -0,0 +1,27 @@
+/*
+ * fusion.h: Declares macro-op fusion of common LC4 instruction idioms
+ */
+
+#ifndef LC4_FUSION_H
+#define LC4_FUSION_H
+
+#include <stdio.h>
+#include "LC4.h"
+
+extern int FusionEnabled;
+
+// Cycle no fused operation may run past (per thread, e.g. a server job's
+// budget); ULLONG_MAX for none
+extern __thread unsigned long long FusionStopCycle;
+
+/*
+ * If the instructions at PC form a fusible idiom (CONST/HICONST on one
+ * register, a compare or immediate ADD followed by a branch, or a tight
+ * ADD Rx, Rx, #-1 / BRp countdown loop), execute it as one operation, running
+ * at most limit instructions and never past FusionStopCycle. Returns the number of instructions executed,
+ * 0 if nothing was fused. With a trace open, every instruction of the idiom
+ * still gets its own line.
+ */
+unsigned int ExecuteFused(MachineState* CPU, FILE* output, unsigned long long limit);
+
+#endif
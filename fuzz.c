@@ -0,0 +1,443 @@
+/*
+ * fuzz.c: location of main() for the coverage-guided fuzzer
+ *
+ * Loads the objects once and snapshots the machine. Every execution copies
+ * an input from the corpus into the designated input regions, mutates it,
+ * runs under an instruction budget and records edge coverage of branches,
+ * jumps, JSR, RTI and TRAP in an AFL-style bitmap of hit counts. Inputs that
+ * reach new edges join the corpus; inputs that end in a CheckErrors failure
+ * (codes 1-3) or would divide by zero are saved once per kind and PC.
+ *
+ * Only what an execution changed is put back: the registers, and the pages
+ * of memory STR wrote to. Input regions are rewritten by the next input.
+ */
+
+#include <time.h>
+#include <stddef.h>
+#include <sys/stat.h>
+#include "loader.h"
+#include "fastcore.h"
+
+#define USAGE "Please enter ./lc4fuzz [options] --input ADDR:WORDS [--input ...] first.obj ...\n" \
+              "options: --budget N --execs N --seed N --crashes DIR --table-core --replay FILE\n"
+
+#define MAP_SIZE 65536
+#define PAGE_SHIFT 8                    // 256-word pages
+#define PAGES (65536 >> PAGE_SHIFT)
+#define MAX_REGIONS 16
+#define MAX_CORPUS 4096
+#define MAX_CRASHES 1024
+#define DEFAULT_BUDGET 10000
+#define DEFAULT_EXECS 1000000
+
+// results of an execution beyond the UpdateMachineState codes
+#define RESULT_BUDGET 0         // still running when the budget ran out
+#define RESULT_DIV_ZERO 6
+#define RESULT_MOD_ZERO 7
+
+typedef struct {
+    unsigned short int address;
+    unsigned int length;
+} Region;
+
+static MachineState snapshot;
+static MachineState machine;
+static int (*innerStep)(MachineState*, FILE*) = UpdateMachineState;
+
+static Region regions[MAX_REGIONS];
+static int numRegions = 0;
+static unsigned int inputLength = 0;    // words over all regions
+
+// coverage of the current execution and everything seen so far
+static unsigned char traceBits[MAP_SIZE];
+static unsigned char virginBits[MAP_SIZE];
+static unsigned short int* touched;     // indices of traceBits set this execution
+static unsigned int numTouched = 0;
+static unsigned long long edgesFound = 0;
+
+// pages to copy back from the snapshot
+static unsigned char dirty[PAGES];
+static unsigned short int dirtyList[PAGES];
+static unsigned int numDirty = 0;
+
+static unsigned short int* corpus[MAX_CORPUS];
+static int corpusSize = 0;
+
+static unsigned int crashKeys[MAX_CRASHES];
+static int numCrashes = 0;
+
+static unsigned long long randomState = 0x9E3779B97F4A7C15ULL;
+
+//helper function for a xorshift random number
+static unsigned int Random(unsigned int limit)
+{
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 7;
+    randomState ^= randomState << 17;
+    return (unsigned int) (randomState >> 32) % limit;
+}
+
+//helper function to count one transition from pc to target
+static inline void RecordEdge(unsigned short int pc, unsigned short int target)
+{
+    unsigned int index = ((pc * 0x9E37U) ^ target) & (MAP_SIZE - 1);
+
+    if (traceBits[index] == 0) {
+        touched[numTouched++] = index;
+    }
+    if (traceBits[index] != 0xFF) {
+        traceBits[index]++;
+    }
+}
+
+//helper function to run one instruction, catching divides by zero before
+//they raise SIGFPE and noting coverage and dirty pages after
+static int FuzzStep(MachineState* CPU)
+{
+    unsigned short int pc = CPU->PC;
+    unsigned short int inst = CPU->memory[pc];
+    unsigned short int op = inst >> 12;
+    unsigned short int page;
+    int status;
+
+    if (CPU->R[inst & 0x7] == 0 && pc != 0x80FF && CheckErrors(CPU) == 0) {
+        if (op == 0x1 && (inst & 0x38) == 0x18) {
+            return RESULT_DIV_ZERO;
+        }
+        if (op == 0xA && (inst & 0x30) == 0x30) {
+            return RESULT_MOD_ZERO;
+        }
+    }
+
+    status = innerStep(CPU, NULL);
+    if (status != 0) {
+        return status;
+    }
+
+    switch (op) {
+        case 0x7:       // STR
+            page = CPU->dmemAddr >> PAGE_SHIFT;
+            if (!dirty[page]) {
+                dirty[page] = 1;
+                dirtyList[numDirty++] = page;
+            }
+            break;
+        case 0x0:       // branches, NOP excluded
+            if ((inst & 0x0E00) == 0) {
+                break;
+            }
+            /* fall through */
+        case 0x4:       // JSR
+        case 0x8:       // RTI
+        case 0xC:       // JMP
+        case 0xF:       // TRAP
+            RecordEdge(pc, CPU->PC);
+            break;
+    }
+    return 0;
+}
+
+//helper function to put the machine back to the snapshot
+static void Restore(void)
+{
+    unsigned int i;
+    unsigned int base;
+
+    memcpy(&machine, &snapshot, offsetof(MachineState, memory));
+    for (i = 0; i < numDirty; i++) {
+        base = dirtyList[i] << PAGE_SHIFT;
+        memcpy(&machine.store[base], &snapshot.store[base], sizeof(unsigned short int) << PAGE_SHIFT);
+        dirty[dirtyList[i]] = 0;
+    }
+    numDirty = 0;
+}
+
+//helper function to copy input words into the input regions
+static void PlaceInput(unsigned short int* input)
+{
+    int r;
+
+    for (r = 0; r < numRegions; r++) {
+        memcpy(&machine.store[regions[r].address], input, regions[r].length * sizeof(unsigned short int));
+        input += regions[r].length;
+    }
+}
+
+//helper function to run the input already in memory, returns its result
+static int Execute(unsigned long long budget)
+{
+    int status = RESULT_BUDGET;
+
+    while (machine.cycle < budget) {
+        status = FuzzStep(&machine);
+        if (status != 0) {
+            break;
+        }
+    }
+    return status == 0 ? RESULT_BUDGET : status;
+}
+
+//helper function to fold this execution's hit counts into the global map;
+//returns 1 if an edge or hit count bucket was new
+static int NewCoverage(void)
+{
+    static const unsigned char buckets[9] = { 0, 1, 2, 4, 8, 8, 8, 8, 16 };
+    unsigned char bucket;
+    unsigned char count;
+    unsigned int i, index;
+    int found = 0;
+
+    for (i = 0; i < numTouched; i++) {
+        index = touched[i];
+        count = traceBits[index];
+        bucket = count <= 3 ? buckets[count] : count < 8 ? 8 : count < 16 ? 16 : count < 32 ? 32 : count < 128 ? 64 : 128;
+        if (bucket & ~virginBits[index]) {
+            if (virginBits[index] == 0) {
+                edgesFound++;
+            }
+            virginBits[index] |= bucket;
+            found = 1;
+        }
+        traceBits[index] = 0;
+    }
+    numTouched = 0;
+    return found;
+}
+
+//helper function to change a few words of input at random
+static void Mutate(unsigned short int* input)
+{
+    static const unsigned short int interesting[] = { 0x0000, 0x0001, 0x0002, 0x0010, 0x007F, 0x0080,
+                                                      0x00FF, 0x2000, 0x7FFF, 0x8000, 0xFFFF, 0xFFFE };
+    int n = 1 << Random(4);
+    unsigned int at, from, length;
+
+    while (n-- > 0) {
+        at = Random(inputLength);
+        switch (Random(6)) {
+            case 0:     // flip a bit
+                input[at] ^= 1 << Random(16);
+                break;
+            case 1:     // small step
+                input[at] += Random(33) - 16;
+                break;
+            case 2:     // boundary value
+                input[at] = interesting[Random(sizeof(interesting) / sizeof(interesting[0]))];
+                break;
+            case 3:     // any value
+                input[at] = Random(0x10000);
+                break;
+            case 4:     // a byte only
+                input[at] = (input[at] & 0xFF00) | Random(0x100);
+                break;
+            case 5:     // copy a run of words
+                from = Random(inputLength);
+                length = 1 + Random(inputLength - (at > from ? at : from));
+                memmove(&input[at], &input[from], length * sizeof(unsigned short int));
+                break;
+        }
+    }
+}
+
+//helper function to add input to the corpus
+static void AddToCorpus(unsigned short int* input)
+{
+    if (corpusSize < MAX_CORPUS) {
+        corpus[corpusSize] = malloc(inputLength * sizeof(unsigned short int));
+        if (corpus[corpusSize] != NULL) {
+            memcpy(corpus[corpusSize++], input, inputLength * sizeof(unsigned short int));
+        }
+    }
+}
+
+//helper function to name a result
+static const char* ResultName(int status)
+{
+    switch (status) {
+        case RESULT_BUDGET:
+            return "budget";
+        case 1:
+            return "execute-data";
+        case 2:
+            return "read-code";
+        case 3:
+            return "privilege";
+        case 4:
+            return "exit";
+        case RESULT_DIV_ZERO:
+            return "div-zero";
+        case RESULT_MOD_ZERO:
+            return "mod-zero";
+        default:
+            return "unknown";
+    }
+}
+
+//helper function to save input once per kind of crash and PC, big-endian words
+static void SaveCrash(char* directory, int status, unsigned short int pc, unsigned short int* input)
+{
+    unsigned int key = status << 16 | pc;
+    char filename[FILENAME_MAX];
+    FILE* output_p;
+    unsigned int i;
+    int k;
+
+    for (k = 0; k < numCrashes; k++) {
+        if (crashKeys[k] == key) {
+            return;
+        }
+    }
+    if (numCrashes < MAX_CRASHES) {
+        crashKeys[numCrashes++] = key;
+    }
+
+    fprintf(stderr, "crash: %s at PC %04X\n", ResultName(status), pc);
+    snprintf(filename, sizeof(filename), "%s/%s-%04X.bin", directory, ResultName(status), pc);
+    output_p = fopen(filename, "wb");
+    if (output_p == NULL) {
+        perror("error: Cannot save the crash");
+        return;
+    }
+    for (i = 0; i < inputLength; i++) {
+        fputc(input[i] >> 8, output_p);
+        fputc(input[i] & 0xFF, output_p);
+    }
+    fclose(output_p);
+}
+
+int main(int argc, char** argv)
+{
+    unsigned long long budget = DEFAULT_BUDGET;
+    unsigned long long execs = DEFAULT_EXECS;
+    unsigned long long n, hangs = 0;
+    char* crashDir = "crashes";
+    char* replay = NULL;
+    unsigned short int* input;
+    unsigned int address, length, i;
+    struct timespec start, now;
+    double seconds, lastReport = 0;
+    FILE* input_p;
+    int high, low;
+    int status;
+    int r;
+
+    // options come before the object files
+    for (r = 1; r < argc && strncmp(argv[r], "--", 2) == 0; r++) {
+        if (strcmp(argv[r], "--input") == 0 && r + 1 < argc) {    // region to mutate, hex ADDR:WORDS
+            if (numRegions == MAX_REGIONS || sscanf(argv[++r], "%x:%u", &address, &length) != 2
+                    || length == 0 || address + length > 0x10000) {
+                fprintf(stderr, "error: bad input region %s\n", argv[r]);
+                return -1;
+            }
+            regions[numRegions].address = address;
+            regions[numRegions].length = length;
+            numRegions++;
+            inputLength += length;
+        } else if (strcmp(argv[r], "--budget") == 0 && r + 1 < argc) {   // instructions per execution
+            budget = strtoull(argv[++r], NULL, 0);
+        } else if (strcmp(argv[r], "--execs") == 0 && r + 1 < argc) {
+            execs = strtoull(argv[++r], NULL, 0);
+        } else if (strcmp(argv[r], "--seed") == 0 && r + 1 < argc) {
+            randomState = strtoull(argv[++r], NULL, 0) | 1;
+        } else if (strcmp(argv[r], "--crashes") == 0 && r + 1 < argc) {
+            crashDir = argv[++r];
+        } else if (strcmp(argv[r], "--table-core") == 0) {
+            innerStep = UpdateMachineStateFast;
+        } else if (strcmp(argv[r], "--replay") == 0 && r + 1 < argc) {   // run one saved input
+            replay = argv[++r];
+        } else {
+            fprintf(stderr, "error: unknown option %s\n", argv[r]);
+            perror(USAGE);
+            return -1;
+        }
+    }
+    if (r >= argc || numRegions == 0) {
+        perror(USAGE);
+        return -1;
+    }
+
+    Reset(&snapshot);
+    for (; r < argc; r++) {
+        if (ReadObjectFile(argv[r], &snapshot) == -1) {
+            perror(USAGE);
+            return -1;
+        }
+    }
+    CopyMachineState(&machine, &snapshot);
+
+    input = malloc(inputLength * sizeof(unsigned short int));
+    touched = malloc(budget < MAP_SIZE ? (budget + 1) * sizeof(unsigned short int) : MAP_SIZE * sizeof(unsigned short int));
+    if (input == NULL || touched == NULL) {
+        perror("error: Cannot allocate the fuzzer");
+        return -1;
+    }
+
+    // the loaded contents of the regions are the first input
+    length = 0;
+    for (r = 0; r < numRegions; r++) {
+        memcpy(&input[length], &snapshot.store[regions[r].address], regions[r].length * sizeof(unsigned short int));
+        length += regions[r].length;
+    }
+
+    if (replay != NULL) {
+        input_p = fopen(replay, "rb");
+        if (input_p == NULL) {
+            perror("error: Cannot open the input");
+            return -1;
+        }
+        for (i = 0; i < inputLength; i++) {
+            high = fgetc(input_p);
+            low = fgetc(input_p);
+            if (high == EOF || low == EOF) {
+                break;
+            }
+            input[i] = high << 8 | low;
+        }
+        fclose(input_p);
+        if (i < inputLength) {
+            fprintf(stderr, "error: %s is shorter than the %u words of the fuzzed regions\n", replay, inputLength);
+            return -1;
+        }
+        PlaceInput(input);
+        status = Execute(budget);
+        printf("%s at PC %04X after %llu instructions\n", ResultName(status), machine.PC, machine.cycle);
+        PrintState(&machine, stdout);
+        return 0;
+    }
+
+    mkdir(crashDir, 0777);
+    AddToCorpus(input);
+    Execute(budget);
+    NewCoverage();
+    Restore();
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (n = 1; n <= execs; n++) {
+        memcpy(input, corpus[n % corpusSize], inputLength * sizeof(unsigned short int));
+        Mutate(input);
+        PlaceInput(input);
+
+        status = Execute(budget);
+        if (status == RESULT_BUDGET) {
+            hangs++;
+        } else if (status != 4) {
+            SaveCrash(crashDir, status, machine.PC, input);
+        }
+        if (NewCoverage()) {
+            AddToCorpus(input);
+        }
+        Restore();
+
+        // a status line every second or so
+        if ((n & 0x3FFF) == 0 || n == execs) {
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            seconds = (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9;
+            if (seconds - lastReport >= 1.0 || n == execs) {
+                fprintf(stderr, "execs %llu (%.0f/s) corpus %d edges %llu crashes %d budget-outs %llu\n",
+                        n, n / seconds, corpusSize, edgesFound, numCrashes, hangs);
+                lastReport = seconds;
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,124 @@
+/*
+ * gentable.c: location of main() for the generator of InsnTable
+ *
+ * Decodes every possible 16-bit instruction word once and writes the C source
+ * of the pre-decoded table used by fastcore.c to stdout.
+ */
+
+#include <stdio.h>
+
+//sign extend helper function
+static int Sext(unsigned int value, unsigned int numBits)
+{
+    if (value & (1 << (numBits - 1))) {
+        return (int) value - (1 << numBits);
+    }
+    return value;
+}
+
+//helper function to print one table entry
+static void Entry(const char* handler, unsigned int rd, unsigned int rs, unsigned int rt, const char* flags, int imm)
+{
+    printf("    { %s, %u, %u, %u, %s, %d },\n", handler, rd, rs, rt, flags, imm);
+}
+
+int main(void)
+{
+    static const char* arithmetic[4] = { "FastADD", "FastMUL", "FastSUB", "FastDIV" };
+    static const char* logical[4] = { "FastAND", "FastNOT", "FastOR", "FastXOR" };
+    static const char* shifts[3] = { "FastSLL", "FastSRA", "FastSRL" };
+    unsigned int inst;
+    unsigned int rd, rs, rt, sub;
+
+    printf("/*\n * insntable.c: generated by gentable, do not edit\n */\n\n");
+    printf("#include \"fastcore.h\"\n\n");
+    printf("const DecodedInsn InsnTable[65536] = {\n");
+
+    for (inst = 0; inst <= 0xFFFF; inst++) {
+        rd = inst >> 9 & 0x7;
+        rs = inst >> 6 & 0x7;
+        rt = inst & 0x7;
+
+        switch (inst >> 12) {
+            case 0x0:       // branches: rd holds the condition codes
+                if (rd == 0) {
+                    Entry("FastBranchNever", rd, 0, 0, "0", 0);
+                } else if (rd == 7) {
+                    Entry("FastBranchAlways", rd, 0, 0, "0", Sext(inst & 0x1FF, 9));
+                } else {
+                    Entry("FastBranch", rd, 0, 0, "0", Sext(inst & 0x1FF, 9));
+                }
+                break;
+            case 0x1:       // arithmetic
+                sub = inst >> 3 & 0x7;
+                if (inst & 0x20) {
+                    Entry("FastADDI", rd, rs, rt, "0", Sext(inst & 0x1F, 5));
+                } else {
+                    Entry(arithmetic[sub], rd, rs, rt, "0", 0);     // sub < 4 with bit 5 clear
+                }
+                break;
+            case 0x2:       // compares: the first register is in bits [11:9]
+                switch (inst >> 7 & 0x3) {
+                    case 0:
+                        Entry("FastCMP", 0, rd, rt, "0", 0);
+                        break;
+                    case 1:
+                        Entry("FastCMPU", 0, rd, rt, "0", 0);
+                        break;
+                    case 2:
+                        Entry("FastCMPI", 0, rd, rt, "0", Sext(inst & 0x7F, 7));
+                        break;
+                    case 3:
+                        Entry("FastCMPIU", 0, rd, rt, "0", inst & 0x7F);
+                        break;
+                }
+                break;
+            case 0x4:
+                Entry("FastJSR", rd, rs, rt, "0", 0);
+                break;
+            case 0x5:       // logical
+                sub = inst >> 3 & 0x7;
+                if (inst & 0x20) {
+                    Entry("FastANDI", rd, rs, rt, "0", Sext(inst & 0x1F, 5));
+                } else {
+                    Entry(logical[sub], rd, rs, rt, "0", 0);
+                }
+                break;
+            case 0x6:
+                Entry("FastLDR", rd, rs, rt, "INSN_MEMORY", Sext(inst & 0x3F, 6));
+                break;
+            case 0x7:
+                Entry("FastSTR", rd, rs, rt, "INSN_MEMORY", Sext(inst & 0x3F, 6));
+                break;
+            case 0x8:
+                Entry("FastRTI", 0, 0, 0, "0", 0);
+                break;
+            case 0x9:
+                Entry("FastCONST", rd, 0, 0, "0", Sext(inst & 0x1FF, 9));
+                break;
+            case 0xA:       // shifts and MOD
+                sub = inst >> 4 & 0x3;
+                if (sub < 3) {
+                    Entry(shifts[sub], rd, rs, 0, "0", inst & 0xF);
+                } else {
+                    Entry("FastMOD", rd, rs, rt, "0", 0);
+                }
+                break;
+            case 0xC:
+                Entry("FastJMP", rd, rs, rt, "0", 0);
+                break;
+            case 0xD:       // the immediate is stored already shifted into the high byte
+                Entry("FastHICONST", rd, 0, 0, "0", (short int) ((inst & 0xFF) << 8));
+                break;
+            case 0xF:
+                Entry("FastTRAP", 0, 0, 0, "0", inst & 0xFF);
+                break;
+            default:        // 0x3, 0xB, 0xE do nothing
+                Entry("FastNothing", 0, 0, 0, "0", 0);
+                break;
+        }
+    }
+
+    printf("};\n");
+    return 0;
+}
@@ -0,0 +1,287 @@
+/*
+ * journal.c: Defines the undo journal used for reverse stepping
+ */
+
+#include "journal.h"
+#include "statehash.h"
+#include "fusion.h"
+
+// flags of a journal entry
+#define ENTRY_REG_MASK 0x7      // register that was written
+#define ENTRY_REG_VALID 0x8     // R holds the old register value
+#define ENTRY_MEM_VALID 0x10    // memory holds the old word at address
+
+typedef struct {
+    unsigned short int PC;          // old PC
+    unsigned short int PSR;         // old PSR (TRAP and RTI change it)
+    unsigned short int R;           // old value of the register written
+    unsigned short int address;     // address stored to
+    unsigned short int memory;      // old value of the word stored to
+    unsigned char NZPVal;           // old NZP value
+    unsigned char flags;
+} JournalEntry;
+
+static JournalEntry* ring = NULL;
+static unsigned int capacity = 0;
+static unsigned int head = 0;       // next entry to write
+static unsigned int count = 0;      // entries currently held
+
+static MachineState* snapshots = NULL;
+static unsigned int snapshotSlots = 0;
+static unsigned int snapshotHead = 0;   // next slot to write
+static unsigned int snapshotCount = 0;
+static unsigned long long nextSnapshotCycle = 0;
+
+/*
+ * Allocate a ring of undo entries (12 bytes each) plus room for full machine
+ * snapshots, which are taken every ring-length cycles so that history older
+ * than the ring can still be reached by replaying forward. Turns journaling
+ * on. Returns -1 if the memory is not available.
+ */
+int JournalInit(unsigned int entries, unsigned int snapshotsKept)
+{
+    JournalFree();
+
+    if (entries == 0) {
+        return -1;
+    }
+
+    ring = malloc(sizeof(JournalEntry) * entries);
+    snapshots = snapshotsKept > 0 ? malloc(sizeof(MachineState) * snapshotsKept) : NULL;
+    if (ring == NULL || (snapshotsKept > 0 && snapshots == NULL)) {
+        JournalFree();
+        return -1;
+    }
+
+    capacity = entries;
+    snapshotSlots = snapshotsKept;
+    SimHooks |= HOOK_JOURNAL;
+    return 0;
+}
+
+/*
+ * Free the journal and turn journaling off.
+ */
+void JournalFree(void)
+{
+    free(ring);
+    free(snapshots);
+    ring = NULL;
+    snapshots = NULL;
+    capacity = head = count = 0;
+    snapshotSlots = snapshotHead = snapshotCount = 0;
+    nextSnapshotCycle = 0;
+    SimHooks &= ~HOOK_JOURNAL;
+}
+
+//helper function to get the k-th newest snapshot (k = 0 is the newest)
+static MachineState* Snapshot(unsigned int k)
+{
+    return &snapshots[(snapshotHead + snapshotSlots - 1 - k) % snapshotSlots];
+}
+
+//helper function to forget snapshots taken after the current cycle
+static void DropNewerSnapshots(MachineState* CPU)
+{
+    while (snapshotCount > 0 && Snapshot(0)->cycle > CPU->cycle) {
+        snapshotHead = (snapshotHead + snapshotSlots - 1) % snapshotSlots;
+        snapshotCount--;
+    }
+    nextSnapshotCycle = snapshotCount > 0 ? Snapshot(0)->cycle + capacity : 0;
+}
+
+/*
+ * Record what the instruction at PC is about to overwrite (called before it executes).
+ */
+void JournalRecord(MachineState* CPU)
+{
+    unsigned short int inst = CPU->memory[CPU->PC];
+    JournalEntry* entry = &ring[head];
+    short int imm6;
+
+    // once per ring length keep a full copy for history the ring no longer covers
+    if (snapshotSlots > 0 && CPU->cycle >= nextSnapshotCycle) {
+        CopyMachineState(&snapshots[snapshotHead], CPU);
+        snapshotHead = (snapshotHead + 1) % snapshotSlots;
+        if (snapshotCount < snapshotSlots) {
+            snapshotCount++;
+        }
+        nextSnapshotCycle = CPU->cycle + capacity;
+    }
+
+    entry->PC = CPU->PC;
+    entry->PSR = CPU->PSR;
+    entry->NZPVal = CPU->NZPVal;
+    entry->flags = 0;
+
+    switch (inst >> 12) {
+        case 0x1:       // arithmetic
+        case 0x5:       // logical
+        case 0x6:       // LDR
+        case 0x9:       // CONST
+        case 0xA:       // shift/mod
+        case 0xD:       // HICONST
+            entry->flags = ENTRY_REG_VALID | ((inst >> 9) & 0x7);
+            break;
+        case 0x4:       // JSR
+        case 0xF:       // TRAP
+            entry->flags = ENTRY_REG_VALID | 7;
+            break;
+        case 0x7:       // STR
+            imm6 = inst & 0x20 ? (inst & 0x3F) - 0x40 : inst & 0x3F;
+            entry->address = CPU->R[(inst >> 6) & 0x7] + imm6;
+            entry->memory = CPU->memory[entry->address];
+            entry->flags = ENTRY_MEM_VALID;
+            break;
+        default:
+            break;
+    }
+    if (entry->flags & ENTRY_REG_VALID) {
+        entry->R = CPU->R[entry->flags & ENTRY_REG_MASK];
+    }
+
+    head = (head + 1) % capacity;
+    if (count < capacity) {
+        count++;
+    }
+}
+
+//helper function to undo the newest journal entry
+static void UndoEntry(MachineState* CPU)
+{
+    JournalEntry* entry;
+
+    head = (head + capacity - 1) % capacity;
+    count--;
+    entry = &ring[head];
+
+    CPU->PC = entry->PC;
+    CPU->PSR = entry->PSR;
+    CPU->NZPVal = entry->NZPVal;
+    if (entry->flags & ENTRY_REG_VALID) {
+        CPU->R[entry->flags & ENTRY_REG_MASK] = entry->R;
+    }
+    if (entry->flags & ENTRY_MEM_VALID) {
+        if (StateHashOn) {
+            StateHashWrite(CPU, entry->address, entry->memory);
+        }
+        CPU->memory[entry->address] = entry->memory;
+    }
+    CPU->cycle--;
+}
+
+/*
+ * Undo the last n cycles. Returns the number of cycles actually undone.
+ */
+unsigned long long JournalStepBack(MachineState* CPU, unsigned long long n)
+{
+    unsigned long long start = CPU->cycle;
+    unsigned long long target = n > CPU->cycle ? 0 : CPU->cycle - n;
+    unsigned int hooks;
+    unsigned int k;
+
+    while (count > 0 && CPU->cycle > target) {
+        UndoEntry(CPU);
+    }
+
+    if (CPU->cycle > target) {
+        // the ring has wrapped: restart from the newest snapshot before target
+        for (k = 0; k < snapshotCount && Snapshot(k)->cycle > target; k++) {
+        }
+        if (snapshotCount == 0) {
+            return start - CPU->cycle;     // history does not reach that far back
+        }
+        if (k == snapshotCount) {
+            k = snapshotCount - 1;      // get as close as history allows
+            target = Snapshot(k)->cycle;
+        }
+
+        CopyMachineState(CPU, Snapshot(k));
+        count = 0;
+        DropNewerSnapshots(CPU);
+
+        // replay without a trace, journaling as we go; the timing and cache
+        // models already saw these cycles
+        hooks = SimHooks;
+        SimHooks = HOOK_JOURNAL;
+        while (CPU->cycle < target) {
+            if (UpdateMachineState(CPU, NULL) != 0) {
+                break;
+            }
+        }
+        SimHooks = hooks;
+    }
+
+    DropNewerSnapshots(CPU);
+    return start - CPU->cycle;
+}
+
+/*
+ * Go back to the most recent cycle at which the machine was about to execute
+ * the instruction at pc. Returns -1 if that is no longer in the journal.
+ */
+int JournalRunBackTo(MachineState* CPU, unsigned short int pc)
+{
+    MachineState* scratch;
+    unsigned long long endCycle = CPU->cycle - count;
+    unsigned long long found;
+    unsigned int hooks;
+    unsigned int k;
+    int foundAny;
+    int fused;
+
+    // newest first through the ring
+    for (k = 1; k <= count; k++) {
+        if (ring[(head + capacity - k) % capacity].PC == pc) {
+            return JournalStepBack(CPU, k) == k ? 0 : -1;
+        }
+    }
+
+    if (snapshotCount == 0) {
+        return -1;
+    }
+
+    scratch = malloc(sizeof(MachineState));
+    if (scratch == NULL) {
+        return -1;
+    }
+
+    // replay each older stretch on a scratch machine, newest stretch first,
+    // one instruction at a time so no PC is stepped over, and out of sight
+    // of the other hooks
+    hooks = SimHooks;
+    fused = FusionEnabled;
+    SimHooks = 0;
+    FusionEnabled = 0;
+    for (k = 0; k < snapshotCount; k++) {
+        if (Snapshot(k)->cycle >= endCycle) {
+            continue;
+        }
+
+        CopyMachineState(scratch, Snapshot(k));
+        foundAny = 0;
+        while (scratch->cycle < endCycle) {
+            if (scratch->PC == pc) {
+                found = scratch->cycle;
+                foundAny = 1;
+            }
+            if (UpdateMachineState(scratch, NULL) != 0) {
+                break;
+            }
+        }
+
+        if (foundAny) {
+            SimHooks = hooks;
+            FusionEnabled = fused;
+            free(scratch);
+            JournalStepBack(CPU, CPU->cycle - found);
+            return CPU->cycle == found ? 0 : -1;
+        }
+        endCycle = Snapshot(k)->cycle;
+    }
+    SimHooks = hooks;
+    FusionEnabled = fused;
+
+    free(scratch);
+    return -1;
+}
@@ -0,0 +1,43 @@
+/*
+ * journal.h: Declares the undo journal used for reverse stepping
+ */
+
+#ifndef LC4_JOURNAL_H
+#define LC4_JOURNAL_H
+
+#include "LC4.h"
+
+// Default journal size: entries in the undo ring and full snapshots kept
+#define JOURNAL_DEFAULT_ENTRIES 65536
+#define JOURNAL_DEFAULT_SNAPSHOTS 4
+
+/*
+ * Allocate a ring of undo entries (12 bytes each) plus room for full machine
+ * snapshots, which are taken every ring-length cycles so that history older
+ * than the ring can still be reached by replaying forward. Turns journaling
+ * on. Returns -1 if the memory is not available.
+ */
+int JournalInit(unsigned int entries, unsigned int snapshotsKept);
+
+/*
+ * Free the journal and turn journaling off.
+ */
+void JournalFree(void);
+
+/*
+ * Record what the instruction at PC is about to overwrite (called before it executes).
+ */
+void JournalRecord(MachineState* CPU);
+
+/*
+ * Undo the last n cycles. Returns the number of cycles actually undone.
+ */
+unsigned long long JournalStepBack(MachineState* CPU, unsigned long long n);
+
+/*
+ * Go back to the most recent cycle at which the machine was about to execute
+ * the instruction at pc. Returns -1 if that is no longer in the journal.
+ */
+int JournalRunBackTo(MachineState* CPU, unsigned short int pc);
+
+#endif
@@ -0,0 +1,111 @@
+/*
+ * lc4top.c: location of main() for the live statistics viewer
+ *
+ * Lists the statistics segment of every simulator started with --stats and
+ * prints one line per run. The segments are only read, so the simulators
+ * never wait on lc4top. A run leaves its segment behind when it exits, so
+ * its final status stays visible until --clean removes it.
+ */
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "stats.h"
+
+#define USAGE "Please enter ./lc4top [--watch SECONDS] [--clean]\n"
+
+//helper function to print the line of one segment; returns -1 if its simulator is gone
+static int ShowSegment(const char* name)
+{
+    char path[FILENAME_MAX];
+    StatsBlock* segment;
+    StatsSnapshot snapshot;
+    int fd;
+    int alive;
+
+    snprintf(path, sizeof(path), "/%s", name);
+    fd = shm_open(path, O_RDONLY, 0);
+    if (fd == -1) {
+        return 0;       // removed since the directory was read
+    }
+    segment = mmap(NULL, sizeof(StatsBlock), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (segment == MAP_FAILED) {
+        return 0;
+    }
+    if (StatsRead(segment, &snapshot) == -1) {
+        munmap(segment, sizeof(StatsBlock));
+        return 0;
+    }
+    munmap(segment, sizeof(StatsBlock));
+
+    alive = kill(snapshot.pid, 0) == 0;
+    printf("%7d %-20.20s %14llu %9.2f %12llu  %04X %-16.16s ",
+           (int) snapshot.pid, snapshot.program, snapshot.retired, snapshot.mips,
+           snapshot.traceBytes, snapshot.pc, snapshot.symbol);
+    if (!alive && snapshot.status == STATS_RUNNING) {
+        printf("gone\n");      // killed before it stopped
+    } else if (snapshot.status == STATS_RUNNING) {
+        printf("running\n");
+    } else {
+        printf("%d%s\n", snapshot.status, alive ? "" : " exited");
+    }
+    return alive ? 0 : -1;
+}
+
+int main(int argc, char** argv)
+{
+    unsigned int watch = 0;
+    int clean = 0;
+    DIR* directory;
+    struct dirent* entry;
+    char path[FILENAME_MAX];
+    int i;
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--watch") == 0 && i + 1 < argc) {    // refresh every SECONDS
+            watch = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--clean") == 0) {     // remove the segments of runs that have exited
+            clean = 1;
+        } else {
+            fprintf(stderr, "error: unknown option %s\n", argv[i]);
+            perror(USAGE);
+            return -1;
+        }
+    }
+
+    while (1) {
+        directory = opendir(STATS_DIRECTORY);
+        if (directory == NULL) {
+            perror("error: Cannot list " STATS_DIRECTORY);
+            return -1;
+        }
+        if (watch > 0) {
+            printf("\033[H\033[2J");
+        }
+        printf("%7s %-20s %14s %9s %12s  %4s %-16s %s\n",
+               "PID", "PROGRAM", "RETIRED", "MIPS", "TRACE", "PC", "SYMBOL", "STATUS");
+        while ((entry = readdir(directory)) != NULL) {
+            if (strncmp(entry->d_name, STATS_PREFIX, strlen(STATS_PREFIX)) != 0) {
+                continue;
+            }
+            if (ShowSegment(entry->d_name) == -1 && clean) {
+                snprintf(path, sizeof(path), "/%s", entry->d_name);
+                shm_unlink(path);
+            }
+        }
+        closedir(directory);
+        fflush(stdout);
+
+        if (watch == 0) {
+            break;
+        }
+        sleep(watch);
+    }
+    return 0;
+}
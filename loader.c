@@ -5,6 +5,17 @@
 #include "loader.h"
 #define CONCAT_DIGITS(D1, D2) ((D1 << 8) | D2)   // macro definition for concat two bytes
 
+// symbols from every file loaded so far, sorted by address when looked up
+typedef struct {
+    unsigned short int address;
+    char* name;
+} Symbol;
+
+static Symbol* symbols = NULL;
+static int numSymbols = 0;
+static int maxSymbols = 0;
+static int symbolsSorted = 1;
+
 /*
  * Read an object file and modify the machine state as described in the writeup
  */
@@ -43,11 +54,31 @@ int ReadObjectFile(char* filename, MachineState* CPU)
     }
   }
 
-  close(input_p); //close file
+  fclose(input_p); //close file
   
   return 0;
 }
 
+//helper function to remember a symbol, returns -1 if there is no room
+static int AddSymbol(unsigned short int address, char* name)
+{
+    Symbol* grown;
+
+    if (numSymbols == maxSymbols) {
+        grown = realloc(symbols, (maxSymbols > 0 ? maxSymbols * 2 : 64) * sizeof(Symbol));
+        if (grown == NULL) {
+            return -1;
+        }
+        symbols = grown;
+        maxSymbols = maxSymbols > 0 ? maxSymbols * 2 : 64;
+    }
+    symbols[numSymbols].address = address;
+    symbols[numSymbols].name = name;
+    numSymbols++;
+    symbolsSorted = 0;
+    return 0;
+}
+
 //helper function to parse data and code directives
 parse(FILE* input_p, MachineState* CPU) {
     unsigned short int dig1;
@@ -82,12 +113,15 @@ parse_symbolOrFile(FILE* input_p, MachineState* CPU, int type) {
     unsigned short int numLines;
     //unsigned short int line;
     unsigned short int i;
+    unsigned short int address = 0;
+    char* name;
 
     //if symbol, retrieve address
     if (type == 0) {
       //retrieve address
       dig1 = fgetc(input_p);
       dig2 = fgetc(input_p);
+      address = CONCAT_DIGITS(dig1, dig2);
     }
     
     //retrieve number of lines/commands
@@ -95,8 +129,99 @@ parse_symbolOrFile(FILE* input_p, MachineState* CPU, int type) {
     dig2 = fgetc(input_p);
     numLines = CONCAT_DIGITS(dig1, dig2);
 
+    name = malloc(numLines + 1);
+
     // perform actions for the number of words in the directive (1 byte)
     for (i = 0; i < numLines; i++) {
         dig1 = fgetc(input_p);
+        if (name != NULL) {
+            name[i] = dig1;
+        }
+    }
+
+    // keep symbol names for lookups, file names are not needed
+    if (name == NULL) {
+        return 0;
+    }
+    name[numLines] = '\0';
+    if (type != 0 || AddSymbol(address, name) == -1) {
+        free(name);
+    }
+    return 0;
+}
+
+//helper function to order symbols by address for qsort
+static int CompareSymbols(const void* a, const void* b)
+{
+    return (int) ((const Symbol*) a)->address - (int) ((const Symbol*) b)->address;
+}
+
+/*
+ * Forget the symbols of every file loaded so far
+ */
+void ClearSymbols(void)
+{
+    int i;
+
+    for (i = 0; i < numSymbols; i++) {
+        free(symbols[i].name);
+    }
+    numSymbols = 0;
+    symbolsSorted = 1;
+}
+
+/*
+ * Address of the symbol called name from the loaded files, or -1 if there is none
+ */
+int LookupSymbol(char* name)
+{
+    int i;
+
+    for (i = 0; i < numSymbols; i++) {
+        if (strcmp(symbols[i].name, name) == 0) {
+            return symbols[i].address;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Name of the i-th symbol loaded (in no particular order), its address in
+ * *address; NULL once i is past the last one
+ */
+const char* SymbolAt(int i, unsigned short int* address)
+{
+    if (i < 0 || i >= numSymbols) {
+        return NULL;
+    }
+    *address = symbols[i].address;
+    return symbols[i].name;
+}
+
+/*
+ * Name of the closest symbol at or below address, or NULL if there is none
+ */
+const char* NearestSymbol(unsigned short int address)
+{
+    int low = 0;
+    int high = numSymbols - 1;
+    int middle;
+    int found = -1;
+
+    if (!symbolsSorted) {
+        qsort(symbols, numSymbols, sizeof(Symbol), CompareSymbols);
+        symbolsSorted = 1;
+    }
+
+    // binary search for the last symbol not above address
+    while (low <= high) {
+        middle = (low + high) / 2;
+        if (symbols[middle].address <= address) {
+            found = middle;
+            low = middle + 1;
+        } else {
+            high = middle - 1;
+        }
     }
+    return found >= 0 ? symbols[found].name : NULL;
 }
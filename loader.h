@@ -2,8 +2,26 @@
  * loader.h: Declares loader functions for opening and loading object files
  */
 
+#ifndef LC4_LOADER_H
+#define LC4_LOADER_H
+
 #include <stdio.h>
 #include "LC4.h"
 
 // Read an object file and modify the machine state as described in the writeup
-int ReadObjectFile(char* filename, MachineState* CPU);
\ No newline at end of file
+int ReadObjectFile(char* filename, MachineState* CPU);
+
+// Address of the symbol called name from the loaded files, or -1 if there is none
+int LookupSymbol(char* name);
+
+// Name of the closest symbol at or below address, or NULL if there is none
+const char* NearestSymbol(unsigned short int address);
+
+// Name of the i-th symbol loaded (in no particular order), its address in
+// *address; NULL once i is past the last one
+const char* SymbolAt(int i, unsigned short int* address);
+
+// Forget the symbols of every file loaded so far
+void ClearSymbols(void);
+
+#endif
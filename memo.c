@@ -0,0 +1,322 @@
+/*
+ * memo.c: Defines the on-disk cache of run results
+ *
+ * An entry is one file, DIR/<key>.lc4memo, holding a header, the initial
+ * and final memory compressed with zlib and then the trace as one deflate
+ * stream up to the end of the file. The key is a 64 bit hash of the initial
+ * registers and memory, MEMO_VERSION, the trace options and (with the
+ * disassembly column) the labels; a hit also compares the initial state in
+ * full, so a hash collision is only ever a miss.
+ *
+ * Entries are written to a temporary name and renamed into place, so runs
+ * sharing a directory never see half an entry.
+ */
+
+#include <stddef.h>
+#include <unistd.h>
+#include <zlib.h>
+#include "memo.h"
+#include "tracefile.h"
+#include "disasm.h"
+#include "statehash.h"
+
+#define MEMO_MAGIC "LC4MEMO1"
+#define MEMO_MAGIC_LENGTH 8
+#define MEMORY_BYTES (65536 * sizeof(unsigned short int))
+#define CHUNK_SIZE 65536
+
+#define OPTION_TRACE 0x1
+#define OPTION_BINARY 0x2
+#define OPTION_DISASM 0x4
+#define OPTION_STATE_HASH 0x8
+
+#define FNV_OFFSET 0xCBF29CE484222325ULL
+#define FNV_PRIME 0x100000001B3ULL
+
+typedef struct {
+    char magic[MEMO_MAGIC_LENGTH];
+    char version[32];
+    unsigned int options;
+    int status;
+    unsigned long long initialLength;       // compressed initial memory
+    unsigned long long finalLength;         // compressed final memory
+    unsigned short int PC;                  // initial registers
+    unsigned short int PSR;
+    unsigned short int R[8];
+    unsigned long long cycle;
+    char registers[offsetof(MachineState, memory)];     // final registers
+} MemoHeader;
+
+// the run looked up last
+static char entryName[FILENAME_MAX];
+static MemoHeader header;
+static unsigned char* initialMemory = NULL;
+
+//helper function to add length bytes to an FNV-1a hash
+static unsigned long long Hash(unsigned long long hash, const void* data, size_t length)
+{
+    const unsigned char* bytes = data;
+    size_t i;
+
+    for (i = 0; i < length; i++) {
+        hash = (hash ^ bytes[i]) * FNV_PRIME;
+    }
+    return hash;
+}
+
+//helper function to hash the initial state of CPU and the options in header
+static unsigned long long Key(MachineState* CPU)
+{
+    unsigned long long hash = FNV_OFFSET;
+    const char* label;
+    unsigned int i;
+
+    hash = Hash(hash, header.version, sizeof(header.version));
+    hash = Hash(hash, &header.options, sizeof(header.options));
+    hash = Hash(hash, &header.PC, sizeof(header.PC));
+    hash = Hash(hash, &header.PSR, sizeof(header.PSR));
+    hash = Hash(hash, header.R, sizeof(header.R));
+    hash = Hash(hash, &header.cycle, sizeof(header.cycle));
+
+    // one multiply per word rather than per byte
+    for (i = 0; i <= 0xFFFF; i++) {
+        hash = (hash ^ CPU->memory[i]) * FNV_PRIME;
+    }
+
+    // labels change the disassembly column but not the machine
+    for (i = 0; (header.options & OPTION_DISASM) && i <= 0xFFFF; i++) {
+        label = DisasmLabel(i);
+        if (label != NULL) {
+            hash = Hash(hash, &i, sizeof(i));
+            hash = Hash(hash, label, strlen(label) + 1);
+        }
+    }
+    return hash;
+}
+
+//helper function to inflate the rest of input into output
+static int InflateStream(FILE* input, FILE* output)
+{
+    unsigned char in[CHUNK_SIZE];
+    unsigned char out[CHUNK_SIZE];
+    z_stream stream;
+    int result = Z_OK;
+
+    memset(&stream, 0, sizeof(stream));
+    if (inflateInit(&stream) != Z_OK) {
+        return -1;
+    }
+    while (result != Z_STREAM_END) {
+        stream.avail_in = fread(in, 1, CHUNK_SIZE, input);
+        stream.next_in = in;
+        if (stream.avail_in == 0) {
+            break;      // truncated
+        }
+        while (stream.avail_in > 0 && result != Z_STREAM_END) {
+            stream.avail_out = CHUNK_SIZE;
+            stream.next_out = out;
+            result = inflate(&stream, Z_NO_FLUSH);
+            if (result != Z_OK && result != Z_STREAM_END) {
+                inflateEnd(&stream);
+                return -1;
+            }
+            fwrite(out, 1, CHUNK_SIZE - stream.avail_out, output);
+        }
+    }
+    inflateEnd(&stream);
+    return result == Z_STREAM_END ? 0 : -1;
+}
+
+//helper function to deflate the rest of input into output
+static int DeflateStream(FILE* input, FILE* output)
+{
+    unsigned char in[CHUNK_SIZE];
+    unsigned char out[CHUNK_SIZE];
+    z_stream stream;
+    int flush;
+
+    memset(&stream, 0, sizeof(stream));
+    if (deflateInit(&stream, Z_DEFAULT_COMPRESSION) != Z_OK) {
+        return -1;
+    }
+    do {
+        stream.avail_in = input != NULL ? fread(in, 1, CHUNK_SIZE, input) : 0;
+        stream.next_in = in;
+        flush = stream.avail_in < CHUNK_SIZE ? Z_FINISH : Z_NO_FLUSH;
+        do {
+            stream.avail_out = CHUNK_SIZE;
+            stream.next_out = out;
+            deflate(&stream, flush);
+            if (fwrite(out, 1, CHUNK_SIZE - stream.avail_out, output) != CHUNK_SIZE - stream.avail_out) {
+                deflateEnd(&stream);
+                return -1;
+            }
+        } while (stream.avail_out == 0);
+    } while (flush != Z_FINISH);
+    deflateEnd(&stream);
+    return 0;
+}
+
+//helper function to check that entry is the one for header and read its final state
+static int ReadEntry(FILE* entry, MemoHeader* stored, unsigned char* memory)
+{
+    unsigned char* compressed;
+    uLongf length = MEMORY_BYTES;
+    int result = -1;
+
+    if (fread(stored, sizeof(*stored), 1, entry) != 1
+        || memcmp(stored->magic, header.magic, MEMO_MAGIC_LENGTH) != 0
+        || memcmp(stored->version, header.version, sizeof(header.version)) != 0
+        || stored->options != header.options || stored->initialLength != header.initialLength
+        || stored->PC != header.PC || stored->PSR != header.PSR
+        || memcmp(stored->R, header.R, sizeof(header.R)) != 0 || stored->cycle != header.cycle
+        || stored->finalLength > compressBound(MEMORY_BYTES)) {
+        return -1;
+    }
+
+    compressed = malloc(compressBound(MEMORY_BYTES));
+    if (compressed != NULL
+        && fread(compressed, 1, stored->initialLength, entry) == stored->initialLength
+        && memcmp(compressed, initialMemory, stored->initialLength) == 0
+        && fread(compressed, 1, stored->finalLength, entry) == stored->finalLength
+        && uncompress(memory, &length, compressed, stored->finalLength) == Z_OK
+        && length == MEMORY_BYTES) {
+        result = 0;
+    }
+    free(compressed);
+    return result;
+}
+
+/*
+ * Look up the run that starts from CPU (just loaded) in the cache directory
+ * dir, for the current trace options (traceOn, TraceFormat, the columns).
+ * On a hit CPU becomes the final state, the trace is written to output
+ * (past any binary trace magic already there) and *status is set to the
+ * final UpdateMachineState code; returns 1. Returns 0 on a miss, after
+ * which MemoStore can save the run.
+ */
+int MemoLookup(const char* dir, MachineState* CPU, int traceOn, FILE* output, int* status)
+{
+    MemoHeader stored;
+    unsigned char* memory;
+    uLongf length;
+    FILE* entry;
+    long start;
+    int hit = 0;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MEMO_MAGIC, MEMO_MAGIC_LENGTH);
+    snprintf(header.version, sizeof(header.version), "%s", MEMO_VERSION);
+    header.options = (traceOn ? OPTION_TRACE : 0) | (TraceFormat == TRACE_BINARY ? OPTION_BINARY : 0)
+                     | (DisasmColumn ? OPTION_DISASM : 0) | (SimHooks & HOOK_STATE_HASH ? OPTION_STATE_HASH : 0);
+    header.PC = CPU->PC;
+    header.PSR = CPU->PSR;
+    memcpy(header.R, CPU->R, sizeof(header.R));
+    header.cycle = CPU->cycle;
+    snprintf(entryName, sizeof(entryName), "%s/%016llx.lc4memo", dir, Key(CPU));
+
+    // kept for MemoStore, and to rule out a collision
+    free(initialMemory);
+    length = compressBound(MEMORY_BYTES);
+    initialMemory = malloc(length);
+    if (initialMemory == NULL || compress(initialMemory, &length, (Bytef*) CPU->memory, MEMORY_BYTES) != Z_OK) {
+        free(initialMemory);
+        initialMemory = NULL;
+        return 0;
+    }
+    header.initialLength = length;
+
+    entry = fopen(entryName, "rb");
+    if (entry == NULL) {
+        return 0;
+    }
+    memory = malloc(MEMORY_BYTES);
+    if (memory != NULL && ReadEntry(entry, &stored, memory) == 0) {
+        hit = 1;
+        start = output != NULL ? ftell(output) : 0;
+        if (output != NULL && InflateStream(entry, output) == -1) {
+            // a damaged entry is a miss; take back what was written
+            fprintf(stderr, "error: damaged result cache entry %s\n", entryName);
+            fflush(output);
+            fseek(output, start, SEEK_SET);
+            ftruncate(fileno(output), start);
+            hit = 0;
+        }
+    }
+    if (hit) {
+        memcpy(CPU, stored.registers, sizeof(stored.registers));
+        CPU->memory = CPU->store;
+        memcpy(CPU->memory, memory, MEMORY_BYTES);
+        *status = stored.status;
+    }
+    free(memory);
+    fclose(entry);
+    return hit;
+}
+
+//helper function to write the entry for the run looked up last
+static int WriteEntry(FILE* entry, unsigned char* finalMemory, FILE* trace)
+{
+    if (fwrite(&header, sizeof(header), 1, entry) != 1
+        || fwrite(initialMemory, 1, header.initialLength, entry) != header.initialLength
+        || fwrite(finalMemory, 1, header.finalLength, entry) != header.finalLength) {
+        return -1;
+    }
+    return DeflateStream(trace, entry);
+}
+
+/*
+ * Save the run looked up last with the final state CPU and code status. The
+ * trace is read back from the file traceName starting at offset traceStart
+ * (NULL for none). Returns -1 if the entry cannot be written.
+ */
+int MemoStore(MachineState* CPU, int status, const char* traceName, long traceStart)
+{
+    char temporaryName[FILENAME_MAX + 32];
+    unsigned char* finalMemory;
+    uLongf length = compressBound(MEMORY_BYTES);
+    FILE* trace = NULL;
+    FILE* entry;
+    int result = -1;
+
+    if (initialMemory == NULL) {
+        return -1;
+    }
+    finalMemory = malloc(length);
+    if (finalMemory == NULL || compress(finalMemory, &length, (Bytef*) CPU->memory, MEMORY_BYTES) != Z_OK) {
+        free(finalMemory);
+        return -1;
+    }
+    header.finalLength = length;
+    header.status = status;
+    memcpy(header.registers, CPU, sizeof(header.registers));
+
+    if (traceName != NULL) {
+        trace = fopen(traceName, "rb");
+        if (trace == NULL || fseek(trace, traceStart, SEEK_SET) != 0) {
+            if (trace != NULL) {
+                fclose(trace);
+            }
+            free(finalMemory);
+            return -1;
+        }
+    }
+
+    snprintf(temporaryName, sizeof(temporaryName), "%s.%d.tmp", entryName, (int) getpid());
+    entry = fopen(temporaryName, "wb");
+    if (entry != NULL) {
+        result = WriteEntry(entry, finalMemory, trace);
+        if (fclose(entry) != 0 || (result == 0 && rename(temporaryName, entryName) == -1)) {
+            result = -1;
+        }
+        if (result == -1) {
+            remove(temporaryName);
+        }
+    }
+
+    if (trace != NULL) {
+        fclose(trace);
+    }
+    free(finalMemory);
+    return result;
+}
@@ -0,0 +1,32 @@
+/*
+ * memo.h: Declares the on-disk cache of run results
+ */
+
+#ifndef LC4_MEMO_H
+#define LC4_MEMO_H
+
+#include <stdio.h>
+#include "LC4.h"
+
+// Part of every key; change it whenever a change to the simulator changes
+// the trace or the final state of some program
+#define MEMO_VERSION "lc4 trace 3"
+
+/*
+ * Look up the run that starts from CPU (just loaded) in the cache directory
+ * dir, for the current trace options (traceOn, TraceFormat, the columns).
+ * On a hit CPU becomes the final state, the trace is written to output
+ * (past any binary trace magic already there) and *status is set to the
+ * final UpdateMachineState code; returns 1. Returns 0 on a miss, after
+ * which MemoStore can save the run.
+ */
+int MemoLookup(const char* dir, MachineState* CPU, int traceOn, FILE* output, int* status);
+
+/*
+ * Save the run looked up last with the final state CPU and code status. The
+ * trace is read back from the file traceName starting at offset traceStart
+ * (NULL for none). Returns -1 if the entry cannot be written.
+ */
+int MemoStore(MachineState* CPU, int status, const char* traceName, long traceStart);
+
+#endif
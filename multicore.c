@@ -0,0 +1,179 @@
+/*
+ * multicore.c: Defines multi-core execution over one shared memory
+ *
+ * Every core is a MachineState of its own whose memory points at the memory
+ * of the machine it was started from. In the deterministic mode the cores
+ * pass a turn around under a mutex, which also orders their memory
+ * accesses; free-running cores share memory with no ordering at all, as
+ * real hardware without barriers would.
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include "multicore.h"
+#include "devices.h"
+#include "profile.h"
+#include "stats.h"
+#include "tracefile.h"
+
+typedef struct {
+    pthread_t thread;
+    int index;
+    FILE* output;
+    int status;
+} CoreThread;
+
+static MachineState* cores = NULL;
+static CoreThread threads[MAX_CORES];
+static int coreCount = 0;
+static unsigned int turnLength = 0;
+static int (*coreStep)(MachineState*, FILE*) = UpdateMachineState;
+static int traceFormat = TRACE_TEXT;
+
+// whose turn it is, -1 once every core has stopped
+static int turn = 0;
+static int stopped[MAX_CORES];
+static pthread_mutex_t turnLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t turnChanged = PTHREAD_COND_INITIALIZER;
+
+// set when not every core could be started, so the ones that were give up
+static atomic_int abandoned = 0;
+
+//helper function for the core ID register: the core is known by its machine
+static unsigned short int CoreIdLoad(MachineState* CPU, unsigned short int address)
+{
+    return CPU - cores;
+}
+
+//helper function to run one core on its host thread
+static void* CoreMain(void* arg)
+{
+    CoreThread* self = arg;
+    MachineState* CPU = &cores[self->index];
+    unsigned long long start;
+    int next;
+
+    TraceFormat = traceFormat;      // per thread
+    self->status = 0;
+
+    if (turnLength == 0) {
+        while (!atomic_load_explicit(&abandoned, memory_order_relaxed)
+               && (self->status = coreStep(CPU, self->output)) == 0) {
+            if (self->index == 0 && CPU->cycle >= StatsDue) {
+                StatsUpdate(CPU, self->output, STATS_RUNNING);
+            }
+        }
+        ProfileMerge();
+        return NULL;
+    }
+
+    pthread_mutex_lock(&turnLock);
+    while (1) {
+        while (turn != self->index && !abandoned) {
+            pthread_cond_wait(&turnChanged, &turnLock);
+        }
+        if (abandoned) {
+            break;
+        }
+        pthread_mutex_unlock(&turnLock);
+
+        start = CPU->cycle;
+        while (CPU->cycle - start < turnLength) {
+            self->status = coreStep(CPU, self->output);
+            if (self->status != 0) {
+                break;
+            }
+            if (self->index == 0 && CPU->cycle >= StatsDue) {
+                StatsUpdate(CPU, self->output, STATS_RUNNING);
+            }
+        }
+
+        // hand over to the next core that is still running
+        pthread_mutex_lock(&turnLock);
+        stopped[self->index] = self->status != 0;
+        turn = -1;
+        for (next = 1; next <= coreCount; next++) {
+            if (!stopped[(self->index + next) % coreCount]) {
+                turn = (self->index + next) % coreCount;
+                break;
+            }
+        }
+        pthread_cond_broadcast(&turnChanged);
+        if (self->status != 0) {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&turnLock);
+    ProfileMerge();
+    return NULL;
+}
+
+/*
+ * Run numCores cores on host threads, each starting from the registers of
+ * CPU and all sharing CPU's memory. The OS_CORE_ID device register (and the
+ * emulated TRAP_CORE_ID) tells a core its number. Core i writes its trace to
+ * outputs[i] (NULL for none) and its final UpdateMachineState code to
+ * statuses[i].
+ *
+ * With quantum > 0 the cores take turns of quantum instructions in core
+ * order, so runs are reproducible; with quantum 0 they run freely at once.
+ * Returns -1 if the cores cannot be started.
+ */
+int RunCores(MachineState* CPU, int numCores, unsigned int quantum,
+             int (*step)(MachineState*, FILE*), FILE** outputs, int* statuses)
+{
+    int i;
+
+    if (numCores < 1 || numCores > MAX_CORES) {
+        return -1;
+    }
+    cores = malloc(numCores * sizeof(MachineState));
+    if (cores == NULL) {
+        return -1;
+    }
+    if (RegisterDevice(OS_CORE_ID, OS_CORE_ID, CoreIdLoad, NULL) == -1) {
+        return -1;
+    }
+
+    coreCount = numCores;
+    turnLength = quantum;
+    coreStep = step;
+    traceFormat = TraceFormat;
+    turn = 0;
+    abandoned = 0;
+
+    for (i = 0; i < numCores; i++) {
+        CopyMachineState(&cores[i], CPU);
+        cores[i].memory = CPU->memory;
+        stopped[i] = 0;
+        threads[i].index = i;
+        threads[i].output = outputs[i];
+    }
+
+    for (i = 0; i < numCores; i++) {
+        if (pthread_create(&threads[i].thread, NULL, CoreMain, &threads[i]) != 0) {
+            // stop the cores already running before the caller tears down
+            pthread_mutex_lock(&turnLock);
+            abandoned = 1;
+            pthread_cond_broadcast(&turnChanged);
+            pthread_mutex_unlock(&turnLock);
+            while (--i >= 0) {
+                pthread_join(threads[i].thread, NULL);
+            }
+            return -1;
+        }
+    }
+    for (i = 0; i < numCores; i++) {
+        pthread_join(threads[i].thread, NULL);
+        statuses[i] = threads[i].status;
+    }
+    return 0;
+}
+
+/*
+ * Registers of core i after RunCores, or NULL.
+ */
+MachineState* Core(int i)
+{
+    return cores != NULL && i >= 0 && i < coreCount ? &cores[i] : NULL;
+}
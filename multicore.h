@@ -0,0 +1,35 @@
+/*
+ * multicore.h: Declares multi-core execution over one shared memory
+ */
+
+#ifndef LC4_MULTICORE_H
+#define LC4_MULTICORE_H
+
+#include <stdio.h>
+#include "LC4.h"
+
+#define MAX_CORES 64
+
+// Instructions a core runs before handing over to the next one
+#define DEFAULT_QUANTUM 1000
+
+/*
+ * Run numCores cores on host threads, each starting from the registers of
+ * CPU and all sharing CPU's memory. The OS_CORE_ID device register (and the
+ * emulated TRAP_CORE_ID) tells a core its number. Core i writes its trace to
+ * outputs[i] (NULL for none) and its final UpdateMachineState code to
+ * statuses[i].
+ *
+ * With quantum > 0 the cores take turns of quantum instructions in core
+ * order, so runs are reproducible; with quantum 0 they run freely at once.
+ * Returns -1 if the cores cannot be started.
+ */
+int RunCores(MachineState* CPU, int numCores, unsigned int quantum,
+             int (*step)(MachineState*, FILE*), FILE** outputs, int* statuses);
+
+/*
+ * Registers of core i after RunCores, or NULL.
+ */
+MachineState* Core(int i);
+
+#endif
@@ -0,0 +1,229 @@
+/*
+ * pipeline.c: Defines the timing model of the 5-stage pipelined LC4 datapath
+ *
+ * The functional simulator decides what each instruction does; this model
+ * only counts the cycles the pipeline would spend on it: a load followed by
+ * an instruction using its result (or the NZP bits it set) stalls one cycle,
+ * a wrong branch guess flushes mispredictPenalty cycles, and MUL/DIV/MOD hold
+ * the X stage for their extra latency.
+ */
+
+#include "pipeline.h"
+
+#define READS_NZP 0x100         // source bit for branches
+#define TOP_STALL_PCS 10
+
+// kinds of stall, per-PC counters are kept for each
+#define STALL_LOAD_USE 0
+#define STALL_BRANCH 1
+#define STALL_MULDIV 2
+#define STALL_KINDS 3
+
+static PipelineConfig config;
+
+static unsigned long long instructions = 0;
+static unsigned long long stalls[STALL_KINDS];
+static unsigned long long conditionalBranches = 0;
+static unsigned long long mispredictions = 0;
+
+static unsigned int* stallsAt[STALL_KINDS];     // per PC
+static unsigned char* counters = NULL;          // bimodal predictor
+
+// the instruction ahead in the pipeline, if it was a load
+static int loadAhead = 0;
+static unsigned short int loadAheadRd = 0;
+
+/*
+ * Fill in the default configuration: predict not taken, 2 cycle penalty,
+ * MUL takes 2 extra cycles and DIV/MOD 8.
+ */
+void PipelineDefaults(PipelineConfig* defaults)
+{
+    defaults->predictor = PREDICT_NOT_TAKEN;
+    defaults->predictorBits = 10;
+    defaults->mispredictPenalty = 2;
+    defaults->mulLatency = 2;
+    defaults->divLatency = 8;
+}
+
+/*
+ * Start the timing model with the given configuration. Returns -1 if the
+ * per-PC tables cannot be allocated.
+ */
+int PipelineInit(PipelineConfig* settings)
+{
+    int i;
+
+    config = *settings;
+    if (config.predictorBits > 16) {
+        config.predictorBits = 16;
+    }
+
+    for (i = 0; i < STALL_KINDS; i++) {
+        stallsAt[i] = calloc(65536, sizeof(unsigned int));
+        if (stallsAt[i] == NULL) {
+            return -1;
+        }
+    }
+
+    // counters start weakly not taken
+    counters = malloc(1 << config.predictorBits);
+    if (counters == NULL) {
+        return -1;
+    }
+    memset(counters, 1, 1 << config.predictorBits);
+
+    SimHooks |= HOOK_PIPELINE;
+    return 0;
+}
+
+//helper function to find the registers inst reads (bit i = Ri, READS_NZP for branches)
+static unsigned int SourceRegisters(unsigned short int inst)
+{
+    unsigned int rd = 1 << (inst >> 9 & 0x7);
+    unsigned int rs = 1 << (inst >> 6 & 0x7);
+    unsigned int rt = 1 << (inst & 0x7);
+
+    switch (inst >> 12) {
+        case 0x0:       // BR (NOP reads nothing)
+            return inst >> 9 & 0x7 ? READS_NZP : 0;
+        case 0x1:       // arithmetic
+            return inst & 0x20 ? rs : rs | rt;
+        case 0x2:       // compares: CMPI and CMPIU have no Rt
+            return inst & 0x100 ? rd : rd | rt;
+        case 0x4:       // JSRR reads Rs, JSR nothing
+        case 0xC:       // JMPR reads Rs, JMP nothing
+            return inst & 0x800 ? 0 : rs;
+        case 0x5:       // logical: NOT and the immediate form have no Rt
+            return (inst & 0x20) || (inst >> 3 & 0x7) == 1 ? rs : rs | rt;
+        case 0x6:       // LDR
+        case 0x7:       // STR: store data from a load is bypassed, only the base counts
+            return rs;
+        case 0x8:       // RTI jumps to R7
+            return 1 << 7;
+        case 0xA:       // shifts, MOD
+            return (inst >> 4 & 0x3) == 3 ? rs | rt : rs;
+        case 0xD:       // HICONST keeps the low byte of Rd
+            return rd;
+        default:
+            return 0;
+    }
+}
+
+//helper function to charge stall cycles of one kind to pc
+static void Stall(unsigned short int pc, int kind, unsigned int cycles)
+{
+    stalls[kind] += cycles;
+    stallsAt[kind][pc] += cycles;
+}
+
+/*
+ * Account for the instruction inst at pc that just executed (CPU->PC is
+ * where it went next).
+ */
+void PipelineRetire(MachineState* CPU, unsigned short int pc, unsigned short int inst)
+{
+    unsigned short int op = inst >> 12;
+    unsigned short int cc = inst >> 9 & 0x7;
+    int taken = CPU->PC != (unsigned short int) (pc + 1);
+    int predicted;
+    unsigned char* counter;
+
+    instructions++;
+
+    // load-use hazard: the loaded value (and its NZP bits) arrive one cycle late
+    if (loadAhead && (SourceRegisters(inst) & ((1 << loadAheadRd) | READS_NZP))) {
+        Stall(pc, STALL_LOAD_USE, 1);
+    }
+    loadAhead = op == 0x6;
+    loadAheadRd = cc;
+
+    if (op == 0x0 && cc != 0) {
+        // conditional (or unconditional BRnzp) branch, resolved in X
+        conditionalBranches++;
+        switch (config.predictor) {
+            case PREDICT_TAKEN:
+                predicted = 1;
+                break;
+            case PREDICT_BIMODAL:
+                counter = &counters[pc & ((1 << config.predictorBits) - 1)];
+                predicted = *counter >= 2;
+                if (taken && *counter < 3) {
+                    (*counter)++;
+                } else if (!taken && *counter > 0) {
+                    (*counter)--;
+                }
+                break;
+            default:
+                predicted = 0;
+                break;
+        }
+        if (predicted != taken) {
+            mispredictions++;
+            Stall(pc, STALL_BRANCH, config.mispredictPenalty);
+        }
+    } else if (op == 0x4 || op == 0x8 || op == 0xC || op == 0xF) {
+        // JSR, RTI, JMP and TRAP always redirect fetch from X
+        Stall(pc, STALL_BRANCH, config.mispredictPenalty);
+    } else if (op == 0x1 && (inst & 0x20) == 0 && (inst >> 3 & 0x7) == 1) {
+        Stall(pc, STALL_MULDIV, config.mulLatency);
+    } else if ((op == 0x1 && (inst & 0x20) == 0 && (inst >> 3 & 0x7) == 3) || (op == 0xA && (inst >> 4 & 0x3) == 3)) {
+        Stall(pc, STALL_MULDIV, config.divLatency);
+    }
+}
+
+/*
+ * Write total cycles, CPI, stall totals and the PCs with the most stall cycles.
+ */
+void PipelineReport(FILE* output)
+{
+    unsigned long long totalStalls = stalls[STALL_LOAD_USE] + stalls[STALL_BRANCH] + stalls[STALL_MULDIV];
+    unsigned long long cycles = instructions > 0 ? instructions + PIPELINE_STAGES - 1 + totalStalls : 0;
+    unsigned int top[TOP_STALL_PCS];
+    unsigned int total, best;
+    int numTop = 0;
+    int i, j;
+    unsigned int pc;
+
+    fprintf(output, "pipeline timing model\n");
+    fprintf(output, "instructions     %llu\n", instructions);
+    fprintf(output, "cycles           %llu\n", cycles);
+    fprintf(output, "CPI              %.3f\n", instructions > 0 ? (double) cycles / instructions : 0.0);
+    fprintf(output, "load-use stalls  %llu\n", stalls[STALL_LOAD_USE]);
+    fprintf(output, "branch stalls    %llu (%llu of %llu branches mispredicted)\n",
+            stalls[STALL_BRANCH], mispredictions, conditionalBranches);
+    fprintf(output, "mul/div stalls   %llu\n", stalls[STALL_MULDIV]);
+
+    if (stallsAt[0] == NULL) {
+        return;
+    }
+
+    // pick the PCs with the most stall cycles, largest first
+    for (i = 0; i < TOP_STALL_PCS; i++) {
+        best = 0;
+        for (pc = 0; pc <= 0xFFFF; pc++) {
+            total = stallsAt[STALL_LOAD_USE][pc] + stallsAt[STALL_BRANCH][pc] + stallsAt[STALL_MULDIV][pc];
+            if (total == 0) {
+                continue;
+            }
+            for (j = 0; j < numTop && top[j] != pc; j++) {
+            }
+            if (j == numTop && total > best) {
+                best = total;
+                top[numTop] = pc;
+            }
+        }
+        if (best == 0) {
+            break;
+        }
+        numTop++;
+    }
+
+    fprintf(output, "  PC    stalls  load-use    branch   mul/div\n");
+    for (i = 0; i < numTop; i++) {
+        pc = top[i];
+        fprintf(output, "  %04X %8u  %8u  %8u  %8u\n", pc,
+                stallsAt[STALL_LOAD_USE][pc] + stallsAt[STALL_BRANCH][pc] + stallsAt[STALL_MULDIV][pc],
+                stallsAt[STALL_LOAD_USE][pc], stallsAt[STALL_BRANCH][pc], stallsAt[STALL_MULDIV][pc]);
+    }
+}
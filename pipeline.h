@@ -0,0 +1,50 @@
+/*
+ * pipeline.h: Declares the timing model of the 5-stage pipelined LC4 datapath
+ */
+
+#ifndef LC4_PIPELINE_H
+#define LC4_PIPELINE_H
+
+#include <stdio.h>
+#include "LC4.h"
+
+// Branch predictors for conditional branches
+#define PREDICT_NOT_TAKEN 0     // fetch falls through, taken branches flush
+#define PREDICT_TAKEN 1         // always taken, target from a perfect BTB
+#define PREDICT_BIMODAL 2       // table of 2-bit saturating counters indexed by PC
+
+// Number of stages, so an empty pipeline takes this many cycles minus one to fill
+#define PIPELINE_STAGES 5
+
+typedef struct {
+    int predictor;
+    unsigned int predictorBits;         // log2 of the bimodal table size
+    unsigned int mispredictPenalty;     // cycles flushed on a wrong guess (branches resolve in X)
+    unsigned int mulLatency;            // extra X cycles of MUL
+    unsigned int divLatency;            // extra X cycles of DIV and MOD
+} PipelineConfig;
+
+/*
+ * Fill in the default configuration: predict not taken, 2 cycle penalty,
+ * MUL takes 2 extra cycles and DIV/MOD 8.
+ */
+void PipelineDefaults(PipelineConfig* config);
+
+/*
+ * Start the timing model with the given configuration. Returns -1 if the
+ * per-PC tables cannot be allocated.
+ */
+int PipelineInit(PipelineConfig* config);
+
+/*
+ * Account for the instruction inst at pc that just executed (CPU->PC is
+ * where it went next).
+ */
+void PipelineRetire(MachineState* CPU, unsigned short int pc, unsigned short int inst);
+
+/*
+ * Write total cycles, CPI, stall totals and the PCs with the most stall cycles.
+ */
+void PipelineReport(FILE* output);
+
+#endif
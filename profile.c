@@ -0,0 +1,204 @@
+/*
+ * profile.c: Defines host-level instrumentation of the simulator hot path
+ */
+
+#include "profile.h"
+
+#ifdef LC4_PROFILE
+
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+// names of the profile slots as they appear in the JSON summary
+static const char* slotNames[PROFILE_SLOTS] = {
+    "BranchOp", "ArithmeticOp", "ComparativeOp", "Unused3",
+    "JSROp", "LogicalOp", "LDROp", "STROp",
+    "RTIOp", "ConstOp", "ShiftModOp", "UnusedB",
+    "JumpOp", "HiConstOp", "UnusedE", "TrapOp",
+    "CheckErrors", "WriteOut"
+};
+
+// perf counters read around the run
+#define PERF_INSTRUCTIONS 0
+#define PERF_BRANCH_MISSES 1
+#define PERF_CACHE_MISSES 2
+#define PERF_COUNTERS 3
+
+static const char* perfNames[PERF_COUNTERS] = {
+    "instructions", "branch_misses", "cache_misses"
+};
+
+// counts of the calling thread, added to the totals by ProfileMerge
+static __thread unsigned long long slotCalls[PROFILE_SLOTS];
+static __thread unsigned long long slotCycles[PROFILE_SLOTS];
+
+static unsigned long long totalCalls[PROFILE_SLOTS];
+static unsigned long long totalCycles[PROFILE_SLOTS];
+static pthread_mutex_t totalsLock = PTHREAD_MUTEX_INITIALIZER;
+
+static int perfFds[PERF_COUNTERS] = { -1, -1, -1 };
+static long long perfValues[PERF_COUNTERS];
+
+static struct timespec startTime;
+static double elapsedSeconds;
+static unsigned long long instructionsRetired;
+
+/*
+ * Read the host cycle counter (rdtsc on x86, nanoseconds elsewhere).
+ */
+unsigned long long ProfileTimestamp(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long) now.tv_sec * 1000000000ULL + now.tv_nsec;
+#endif
+}
+
+/*
+ * Add one call taking the given number of host cycles to a profile slot.
+ */
+void ProfileRecord(int slot, unsigned long long cycles)
+{
+    slotCalls[slot]++;
+    slotCycles[slot] += cycles;
+}
+
+#ifdef __linux__
+//helper function to open one user-space hardware counter, -1 if not permitted
+static int OpenCounter(unsigned int type, unsigned long long config)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.inherit = 1;       // cores and parallel trace threads run on threads started later
+
+    return (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+#endif
+
+/*
+ * Open the perf counters (if the host allows it) and start the wall clock.
+ */
+void ProfileStart(void)
+{
+    int i;
+
+#ifdef __linux__
+    perfFds[PERF_INSTRUCTIONS] = OpenCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    perfFds[PERF_BRANCH_MISSES] = OpenCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+    perfFds[PERF_CACHE_MISSES] = OpenCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+
+    for (i = 0; i < PERF_COUNTERS; i++) {
+        if (perfFds[i] >= 0) {
+            ioctl(perfFds[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(perfFds[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+#endif
+
+    clock_gettime(CLOCK_MONOTONIC, &startTime);
+}
+
+/*
+ * Add the slot counts of the calling thread to the run's totals. Threads
+ * that run instructions call it before they exit; ProfileStop does it for
+ * the main thread.
+ */
+void ProfileMerge(void)
+{
+    int i;
+
+    pthread_mutex_lock(&totalsLock);
+    for (i = 0; i < PROFILE_SLOTS; i++) {
+        totalCalls[i] += slotCalls[i];
+        totalCycles[i] += slotCycles[i];
+        slotCalls[i] = 0;
+        slotCycles[i] = 0;
+    }
+    pthread_mutex_unlock(&totalsLock);
+}
+
+/*
+ * Stop the perf counters and the wall clock. retired is the number of
+ * simulated instructions the run executed, whichever core ran them.
+ */
+void ProfileStop(unsigned long long retired)
+{
+    struct timespec stopTime;
+    int i;
+
+    ProfileMerge();
+    instructionsRetired = retired;
+    clock_gettime(CLOCK_MONOTONIC, &stopTime);
+    elapsedSeconds = (stopTime.tv_sec - startTime.tv_sec) + (stopTime.tv_nsec - startTime.tv_nsec) / 1e9;
+
+    for (i = 0; i < PERF_COUNTERS; i++) {
+        perfValues[i] = -1;
+#ifdef __linux__
+        if (perfFds[i] >= 0) {
+            ioctl(perfFds[i], PERF_EVENT_IOC_DISABLE, 0);
+            if (read(perfFds[i], &perfValues[i], sizeof(perfValues[i])) != sizeof(perfValues[i])) {
+                perfValues[i] = -1;
+            }
+            close(perfFds[i]);
+            perfFds[i] = -1;
+        }
+#endif
+    }
+}
+
+/*
+ * Write the JSON summary of the run to output.
+ */
+void ProfileReport(FILE* output)
+{
+    // fused idioms and the table core retire instructions without going
+    // through the handler slots, so the count comes from the machine
+    unsigned long long retired = instructionsRetired;
+    int i;
+
+    fprintf(output, "{\n  \"instructions_retired\": %llu,\n", retired);
+    fprintf(output, "  \"seconds\": %.6f,\n", elapsedSeconds);
+    fprintf(output, "  \"mips\": %.3f,\n", elapsedSeconds > 0 ? retired / elapsedSeconds / 1e6 : 0.0);
+
+    fprintf(output, "  \"handlers\": {");
+    for (i = 0; i < PROFILE_SLOTS; i++) {
+        fprintf(output, "%s\n    \"%s\": { \"calls\": %llu, \"cycles\": %llu }",
+                i == 0 ? "" : ",", slotNames[i], totalCalls[i], totalCycles[i]);
+    }
+    fprintf(output, "\n  },\n");
+
+    // counters the host refused to open are reported as null
+    fprintf(output, "  \"perf\": {");
+    for (i = 0; i < PERF_COUNTERS; i++) {
+        if (perfValues[i] < 0) {
+            fprintf(output, "%s\n    \"%s\": null", i == 0 ? "" : ",", perfNames[i]);
+        } else {
+            fprintf(output, "%s\n    \"%s\": %lld", i == 0 ? "" : ",", perfNames[i], perfValues[i]);
+        }
+    }
+    fprintf(output, "\n  }\n}\n");
+}
+
+#endif
@@ -0,0 +1,69 @@
+/*
+ * profile.h: Declares host-level instrumentation of the simulator hot path
+ *
+ * Build with PROFILE=1 (which defines LC4_PROFILE) to enable it. Without that
+ * flag every macro below expands to nothing and no profiling code is linked in.
+ */
+
+#ifndef LC4_PROFILE_H
+#define LC4_PROFILE_H
+
+#include <stdio.h>
+
+// Profile slots: 0x0 - 0xF are the opcode handlers, the rest are helpers.
+// WriteOut is called from inside the handlers, so its cycles are counted twice.
+#define PROFILE_CHECK_ERRORS 16
+#define PROFILE_WRITE_OUT 17
+#define PROFILE_SLOTS 18
+
+#ifdef LC4_PROFILE
+
+/*
+ * Read the host cycle counter (rdtsc on x86, nanoseconds elsewhere).
+ */
+unsigned long long ProfileTimestamp(void);
+
+/*
+ * Add one call taking the given number of host cycles to a profile slot.
+ */
+void ProfileRecord(int slot, unsigned long long cycles);
+
+/*
+ * Open the perf counters (if the host allows it) and start the wall clock.
+ */
+void ProfileStart(void);
+
+/*
+ * Add the slot counts of the calling thread to the run's totals. Threads
+ * that run instructions call it before they exit; ProfileStop does it for
+ * the main thread.
+ */
+void ProfileMerge(void);
+
+/*
+ * Stop the perf counters and the wall clock. retired is the number of
+ * simulated instructions the run executed, whichever core ran them.
+ */
+void ProfileStop(unsigned long long retired);
+
+/*
+ * Write the JSON summary of the run to output.
+ */
+void ProfileReport(FILE* output);
+
+#define PROFILE_BEGIN(name) unsigned long long profile_##name = ProfileTimestamp()
+#define PROFILE_END(name, slot) ProfileRecord((slot), ProfileTimestamp() - profile_##name)
+
+#else
+
+#define ProfileStart() do { } while (0)
+#define ProfileMerge() do { } while (0)
+#define ProfileStop(retired) do { (void) (retired); } while (0)
+#define ProfileReport(output) do { } while (0)
+
+#define PROFILE_BEGIN(name) do { } while (0)
+#define PROFILE_END(name, slot) do { } while (0)
+
+#endif
+
+#endif
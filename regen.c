@@ -0,0 +1,287 @@
+/*
+ * regen.c: Defines two-phase trace generation from execution checkpoints
+ *
+ * A checkpoint is the registers plus a table of pointers to 256-word pages
+ * of memory. Pages no STR touched since the previous checkpoint are shared
+ * with it, so a checkpoint costs 2KB plus the pages that changed.
+ *
+ * Phase 2 threads take segments in order but may only run a few segments
+ * ahead of the one being appended to the output, which bounds the number of
+ * part files open at once.
+ */
+
+#include <pthread.h>
+#include <stddef.h>
+#include "regen.h"
+#include "fusion.h"
+#include "profile.h"
+#include "stats.h"
+#include "tracefile.h"
+
+#define PAGE_SHIFT 8
+#define PAGE_WORDS (1 << PAGE_SHIFT)
+#define PAGES (65536 >> PAGE_SHIFT)
+#define SEGMENTS_AHEAD_PER_THREAD 4
+#define COPY_BUFFER_SIZE 65536
+
+typedef struct {
+    char registers[offsetof(MachineState, memory)];     // everything but memory
+    unsigned short int* pages[PAGES];
+} Checkpoint;
+
+static Checkpoint* checkpoints = NULL;
+static int numCheckpoints = 0;
+static int maxCheckpoints = 0;
+
+// phase 2 state, shared by the threads under lock
+static int (*segmentStep)(MachineState*, FILE*) = UpdateMachineState;
+static int traceFormat = TRACE_TEXT;
+static FILE** parts = NULL;
+static char* finished = NULL;
+static int nextSegment = 0;
+static int segmentsCopied = 0;
+static int segmentsAhead = 0;
+static int stopping = 0;        // set when the trace cannot be finished
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t changed = PTHREAD_COND_INITIALIZER;
+
+//helper function to checkpoint CPU, copying the pages marked dirty
+static int TakeCheckpoint(MachineState* CPU, unsigned char* dirty)
+{
+    Checkpoint* grown;
+    Checkpoint* checkpoint;
+    int p;
+
+    if (numCheckpoints == maxCheckpoints) {
+        grown = realloc(checkpoints, (maxCheckpoints > 0 ? maxCheckpoints * 2 : 64) * sizeof(Checkpoint));
+        if (grown == NULL) {
+            return -1;
+        }
+        checkpoints = grown;
+        maxCheckpoints = maxCheckpoints > 0 ? maxCheckpoints * 2 : 64;
+    }
+
+    checkpoint = &checkpoints[numCheckpoints];
+    memcpy(checkpoint->registers, CPU, sizeof(checkpoint->registers));
+    for (p = 0; p < PAGES; p++) {
+        if (numCheckpoints > 0 && !dirty[p]) {
+            checkpoint->pages[p] = checkpoints[numCheckpoints - 1].pages[p];
+            continue;
+        }
+        checkpoint->pages[p] = malloc(PAGE_WORDS * sizeof(unsigned short int));
+        if (checkpoint->pages[p] == NULL) {
+            // take back the pages this checkpoint copied, and mark them dirty again
+            while (--p >= 0) {
+                if (numCheckpoints == 0 || checkpoint->pages[p] != checkpoints[numCheckpoints - 1].pages[p]) {
+                    free(checkpoint->pages[p]);
+                    dirty[p] = 1;
+                }
+            }
+            return -1;
+        }
+        memcpy(checkpoint->pages[p], &CPU->memory[p << PAGE_SHIFT], PAGE_WORDS * sizeof(unsigned short int));
+        dirty[p] = 0;
+    }
+    numCheckpoints++;
+    return 0;
+}
+
+//helper function to free the checkpoints and the pages each one copied
+static void FreeCheckpoints(void)
+{
+    int k, p;
+
+    for (k = 0; k < numCheckpoints; k++) {
+        for (p = 0; p < PAGES; p++) {
+            if (k == 0 || checkpoints[k].pages[p] != checkpoints[k - 1].pages[p]) {
+                free(checkpoints[k].pages[p]);
+            }
+        }
+    }
+    free(checkpoints);
+    checkpoints = NULL;
+    numCheckpoints = maxCheckpoints = 0;
+}
+
+//helper function to re-run segment k on machine, writing its trace to output
+static void RunSegment(MachineState* machine, int k, FILE* output)
+{
+    Checkpoint* checkpoint = &checkpoints[k];
+    unsigned long long end;
+    int p;
+
+    memcpy(machine, checkpoint->registers, sizeof(checkpoint->registers));
+    machine->memory = machine->store;
+    for (p = 0; p < PAGES; p++) {
+        memcpy(&machine->store[p << PAGE_SHIFT], checkpoint->pages[p], PAGE_WORDS * sizeof(unsigned short int));
+    }
+
+    // the last segment runs to the end, like the serial loop
+    if (k == numCheckpoints - 1) {
+        while (segmentStep(machine, output) == 0) {
+        }
+        return;
+    }
+    memcpy(&end, checkpoints[k + 1].registers + offsetof(MachineState, cycle), sizeof(end));
+    while (machine->cycle < end && segmentStep(machine, output) == 0) {
+    }
+}
+
+//helper function for the phase 2 threads
+static void* SegmentWorker(void* arg)
+{
+    MachineState* machine = malloc(sizeof(MachineState));
+    FILE* part;
+    int k;
+
+    (void) arg;
+    TraceFormat = traceFormat;      // per thread
+    while (1) {
+        pthread_mutex_lock(&lock);
+        while (!stopping && nextSegment < numCheckpoints && nextSegment >= segmentsCopied + segmentsAhead) {
+            pthread_cond_wait(&changed, &lock);
+        }
+        k = stopping ? numCheckpoints : nextSegment++;
+        pthread_mutex_unlock(&lock);
+        if (k >= numCheckpoints) {
+            break;
+        }
+
+        part = machine != NULL ? tmpfile() : NULL;
+        if (part != NULL) {
+            RunSegment(machine, k, part);
+            rewind(part);
+        }
+
+        pthread_mutex_lock(&lock);
+        parts[k] = part;
+        finished[k] = 1;
+        pthread_cond_broadcast(&changed);
+        pthread_mutex_unlock(&lock);
+    }
+    free(machine);
+    ProfileMerge();
+    return NULL;
+}
+
+/*
+ * Run CPU to the end without a trace, checkpointing every interval cycles,
+ * then re-run the segments between checkpoints on numThreads threads, each
+ * writing its own part of the trace, and append the parts to output in
+ * order. The trace is the one a serial run would write. CPU is left in its
+ * final state. Returns the final UpdateMachineState code, or -1 if memory
+ * or threads run out.
+ *
+ * Console input and devices cannot be replayed, so the run must use neither.
+ */
+int RegenerateTrace(MachineState* CPU, int (*step)(MachineState*, FILE*), FILE* output,
+                    unsigned long long interval, int numThreads)
+{
+    unsigned char dirty[PAGES];
+    unsigned long long nextCheckpoint = interval;
+    pthread_t* threads;
+    char* buffer;
+    size_t length;
+    unsigned short int inst;
+    int fused = FusionEnabled;
+    int status;
+    int k;
+
+    // phase 1: no trace, only checkpoints
+    memset(dirty, 1, sizeof(dirty));
+    if (TakeCheckpoint(CPU, dirty) == -1) {
+        return -1;
+    }
+    while (1) {
+        inst = CPU->memory[CPU->PC];
+        status = step(CPU, NULL);
+        if (status != 0) {
+            break;
+        }
+        if (inst >> 12 == 0x7) {
+            dirty[CPU->dmemAddr >> PAGE_SHIFT] = 1;
+        }
+        if (CPU->cycle >= nextCheckpoint) {
+            if (TakeCheckpoint(CPU, dirty) == -1) {
+                FreeCheckpoints();
+                return -1;
+            }
+            nextCheckpoint = CPU->cycle + interval;
+        }
+        if (CPU->cycle >= StatsDue) {
+            StatsUpdate(CPU, NULL, STATS_RUNNING);
+        }
+    }
+
+    // phase 2: segments end at exact cycles, which fused operations could step over
+    FusionEnabled = 0;
+    segmentStep = step;
+    traceFormat = TraceFormat;
+    nextSegment = 0;
+    segmentsCopied = 0;
+    stopping = 0;
+    segmentsAhead = numThreads * SEGMENTS_AHEAD_PER_THREAD;
+    parts = calloc(numCheckpoints, sizeof(FILE*));
+    finished = calloc(numCheckpoints, 1);
+    threads = malloc(numThreads * sizeof(pthread_t));
+    buffer = malloc(COPY_BUFFER_SIZE);
+    if (parts == NULL || finished == NULL || threads == NULL || buffer == NULL) {
+        status = -1;
+        numThreads = 0;
+    }
+    for (k = 0; k < numThreads; k++) {
+        if (pthread_create(&threads[k], NULL, SegmentWorker, NULL) != 0) {
+            numThreads = k;
+            break;
+        }
+    }
+    if (status != -1 && numThreads == 0) {
+        status = -1;
+    }
+
+    // append the parts in order as they finish
+    for (k = 0; k < numCheckpoints && status != -1; k++) {
+        pthread_mutex_lock(&lock);
+        while (!finished[k]) {
+            pthread_cond_wait(&changed, &lock);
+        }
+        pthread_mutex_unlock(&lock);
+
+        if (parts[k] == NULL) {
+            status = -1;
+            break;
+        }
+        while ((length = fread(buffer, 1, COPY_BUFFER_SIZE, parts[k])) > 0) {
+            fwrite(buffer, 1, length, output);
+        }
+        fclose(parts[k]);
+        parts[k] = NULL;
+
+        pthread_mutex_lock(&lock);
+        segmentsCopied = k + 1;
+        pthread_cond_broadcast(&changed);
+        pthread_mutex_unlock(&lock);
+    }
+
+    // on failure stop the threads before they take another segment
+    pthread_mutex_lock(&lock);
+    stopping = 1;
+    pthread_cond_broadcast(&changed);
+    pthread_mutex_unlock(&lock);
+    for (k = 0; k < numThreads; k++) {
+        pthread_join(threads[k], NULL);
+    }
+
+    for (k = 0; parts != NULL && k < numCheckpoints; k++) {
+        if (parts[k] != NULL) {
+            fclose(parts[k]);
+        }
+    }
+    free(parts);
+    free(finished);
+    free(threads);
+    free(buffer);
+    FreeCheckpoints();
+    FusionEnabled = fused;
+    return status;
+}
@@ -0,0 +1,27 @@
+/*
+ * regen.h: Declares two-phase trace generation from execution checkpoints
+ */
+
+#ifndef LC4_REGEN_H
+#define LC4_REGEN_H
+
+#include <stdio.h>
+#include "LC4.h"
+
+// Cycles between checkpoints when none are given
+#define REGEN_DEFAULT_INTERVAL 1000000
+
+/*
+ * Run CPU to the end without a trace, checkpointing every interval cycles,
+ * then re-run the segments between checkpoints on numThreads threads, each
+ * writing its own part of the trace, and append the parts to output in
+ * order. The trace is the one a serial run would write. CPU is left in its
+ * final state. Returns the final UpdateMachineState code, or -1 if memory
+ * or threads run out.
+ *
+ * Console input and devices cannot be replayed, so the run must use neither.
+ */
+int RegenerateTrace(MachineState* CPU, int (*step)(MachineState*, FILE*), FILE* output,
+                    unsigned long long interval, int numThreads);
+
+#endif
@@ -0,0 +1,409 @@
+/*
+ * server.c: location of main() for the simulation server
+ *
+ * Listens on a Unix domain socket and runs jobs on a pool of worker threads.
+ * Each worker keeps a warm machine: a job starts from a copy of the base
+ * image (Reset plus the objects named on the command line), loads its own
+ * objects and inline words on top and runs until it exits, fails a check or
+ * uses up its instruction budget.
+ *
+ * A connection sends lines of text; each job ends with RUN:
+ *   OBJ path                   load an object file
+ *   WORDS addr w1 w2 ...       store words (hex) starting at addr (hex)
+ *   TRACE text|binary|none [path]
+ *   BUDGET n                   stop after n instructions, 0 for no limit
+ *   RUN                        run the job and reply
+ *   QUIT                       close the connection
+ * and gets back, per job:
+ *   STATUS s CYCLES c PC xxxx PSR xxxx
+ *   REGS xxxx xxxx xxxx xxxx xxxx xxxx xxxx xxxx
+ *   TRACE path|none
+ *   END
+ * or "ERROR message" for a bad line. s is the UpdateMachineState code,
+ * 0 if the budget ran out and -1 for a divide by zero.
+ *
+ * ./lc4server --client socket sends stdin to a running server and prints
+ * the replies, so everything can be tried out on one machine.
+ */
+
+#include <limits.h>
+#include <pthread.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "loader.h"
+#include "fusion.h"
+#include "tracefile.h"
+#include "fastcore.h"
+
+#define USAGE "Please enter ./lc4server [--workers N] [--trace-dir DIR] [--table-core] [--fuse] socket base.obj ...\n" \
+              "         or ./lc4server --client socket\n"
+
+#define DEFAULT_WORKERS 4
+#define MAX_WORKERS 64
+#define QUEUE_SIZE 64
+#define LINE_SIZE 4096
+
+#define STATUS_FAULT -1
+
+typedef struct {
+    pthread_t thread;
+    MachineState* machine;
+} Worker;
+
+static MachineState baseImage;
+static int (*step)(MachineState*, FILE*) = UpdateMachineState;
+static char* traceDir = ".";
+
+// accepted connections waiting for a worker
+static int queue[QUEUE_SIZE];
+static int queueHead = 0;
+static int queueCount = 0;
+static pthread_mutex_t queueLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queueReady = PTHREAD_COND_INITIALIZER;
+
+// the loader keeps a symbol table, so loads take turns
+static pthread_mutex_t loaderLock = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_mutex_t jobLock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned long long nextJob = 0;
+
+// a divide by zero in the guest jumps back to the worker that ran it
+static __thread sigjmp_buf faultJump;
+static __thread int running = 0;
+
+//helper function to turn a guest SIGFPE into a job result
+static void FaultHandler(int signal)
+{
+    if (running) {
+        siglongjmp(faultJump, 1);
+    }
+    _exit(128 + signal);
+}
+
+//helper function to run the job on machine, returns its status
+static int RunJob(MachineState* machine, FILE* output, unsigned long long budget)
+{
+    volatile int status = 0;
+
+    if (sigsetjmp(faultJump, 1) != 0) {
+        running = 0;
+        return STATUS_FAULT;
+    }
+    running = 1;
+    FusionStopCycle = budget > 0 ? budget : ULLONG_MAX;     // a fused loop must not overrun the budget
+    while (budget == 0 || machine->cycle < budget) {
+        status = step(machine, output);
+        if (status != 0) {
+            break;
+        }
+    }
+    running = 0;
+    return status;
+}
+
+//helper function to serve the jobs of one connection on worker's machine
+static void Serve(Worker* worker, int connection)
+{
+    MachineState* machine = worker->machine;
+    FILE* in = fdopen(connection, "r");
+    FILE* out = fdopen(dup(connection), "w");
+    FILE* trace_p;
+    char line[LINE_SIZE];
+    char command[16];
+    char argument[LINE_SIZE];
+    char tracePath[LINE_SIZE];
+    char requestedPath[LINE_SIZE];
+    char* word;
+    char* end;
+    char* save;
+    int fresh = 0;
+    int traceFormat = -1;
+    unsigned long long budget = 0;
+    unsigned long long job;
+    unsigned int address;
+    unsigned long value;
+    int status, i, loaded;
+
+    if (in == NULL || out == NULL) {
+        perror("error: Cannot open the connection");
+        if (in != NULL) {
+            fclose(in);
+        } else {
+            close(connection);
+        }
+        if (out != NULL) {
+            fclose(out);
+        }
+        return;
+    }
+
+    while (fgets(line, sizeof(line), in) != NULL) {
+        argument[0] = '\0';
+        tracePath[0] = '\0';
+        if (sscanf(line, "%15s %4095s %4095s", command, argument, tracePath) < 1) {
+            continue;
+        }
+
+        // every job starts from the base image
+        if (!fresh) {
+            CopyMachineState(machine, &baseImage);
+            traceFormat = -1;
+            requestedPath[0] = '\0';
+            budget = 0;
+            fresh = 1;
+        }
+
+        if (strcmp(command, "OBJ") == 0) {
+            pthread_mutex_lock(&loaderLock);
+            loaded = ReadObjectFile(argument, machine);
+            ClearSymbols();
+            pthread_mutex_unlock(&loaderLock);
+            if (loaded == -1) {
+                fprintf(out, "ERROR cannot load %s\n", argument);
+            }
+        } else if (strcmp(command, "WORDS") == 0) {
+            // strtok_r: the other workers parse their own lines at the same time
+            word = strtok_r(line + 5, " \t\r\n", &save);
+            address = word != NULL ? strtoul(word, NULL, 16) : 0x10000;
+            if (address > 0xFFFF) {
+                fprintf(out, "ERROR bad address\n");
+            } else {
+                while ((word = strtok_r(NULL, " \t\r\n", &save)) != NULL) {
+                    value = strtoul(word, &end, 16);
+                    if (*end != '\0' || value > 0xFFFF) {
+                        fprintf(out, "ERROR bad word %s\n", word);
+                        break;
+                    }
+                    machine->memory[address++ & 0xFFFF] = value;
+                }
+            }
+        } else if (strcmp(command, "TRACE") == 0) {
+            if (strcmp(argument, "text") == 0) {
+                traceFormat = TRACE_TEXT;
+            } else if (strcmp(argument, "binary") == 0) {
+                traceFormat = TRACE_BINARY;
+            } else if (strcmp(argument, "none") == 0) {
+                traceFormat = -1;
+            } else {
+                fprintf(out, "ERROR unknown trace mode %s\n", argument);
+            }
+            strcpy(requestedPath, tracePath);
+        } else if (strcmp(command, "BUDGET") == 0) {
+            budget = strtoull(argument, NULL, 0);
+        } else if (strcmp(command, "RUN") == 0) {
+            trace_p = NULL;
+            if (traceFormat != -1) {
+                if (requestedPath[0] != '\0') {
+                    strcpy(tracePath, requestedPath);
+                } else {
+                    pthread_mutex_lock(&jobLock);
+                    job = nextJob++;
+                    pthread_mutex_unlock(&jobLock);
+                    snprintf(tracePath, sizeof(tracePath), "%s/job-%llu.%s", traceDir, job,
+                             traceFormat == TRACE_BINARY ? "trc" : "txt");
+                }
+                trace_p = fopen(tracePath, "w");
+                if (trace_p == NULL) {
+                    fprintf(out, "ERROR cannot open %s\n", tracePath);
+                    fresh = 0;
+                    fflush(out);
+                    continue;
+                }
+                TraceFormat = traceFormat;
+                if (traceFormat == TRACE_BINARY) {
+                    fwrite(TRACE_MAGIC, 1, TRACE_MAGIC_LENGTH, trace_p);
+                }
+            }
+
+            status = RunJob(machine, trace_p, budget);
+            if (trace_p != NULL) {
+                fclose(trace_p);
+            }
+
+            fprintf(out, "STATUS %d CYCLES %llu PC %04X PSR %04X\nREGS", status,
+                    machine->cycle, machine->PC, machine->PSR);
+            for (i = 0; i < 8; i++) {
+                fprintf(out, " %04X", machine->R[i]);
+            }
+            fprintf(out, "\nTRACE %s\nEND\n", trace_p != NULL ? tracePath : "none");
+            fresh = 0;
+        } else if (strcmp(command, "QUIT") == 0) {
+            break;
+        } else {
+            fprintf(out, "ERROR unknown command %s\n", command);
+        }
+        fflush(out);
+    }
+
+    fclose(in);
+    fclose(out);
+}
+
+//helper function for the worker threads: take connections off the queue
+static void* WorkerMain(void* arg)
+{
+    Worker* worker = arg;
+    int connection;
+
+    while (1) {
+        pthread_mutex_lock(&queueLock);
+        while (queueCount == 0) {
+            pthread_cond_wait(&queueReady, &queueLock);
+        }
+        connection = queue[queueHead];
+        queueHead = (queueHead + 1) % QUEUE_SIZE;
+        queueCount--;
+        pthread_cond_broadcast(&queueReady);
+        pthread_mutex_unlock(&queueLock);
+
+        Serve(worker, connection);
+    }
+    return NULL;
+}
+
+//helper function to open a Unix domain socket at path, listening or connected
+static int OpenSocket(char* path, int listening)
+{
+    struct sockaddr_un address;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (fd == -1) {
+        perror("error: Cannot create the socket");
+        return -1;
+    }
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+
+    if (listening) {
+        unlink(path);
+        if (bind(fd, (struct sockaddr*) &address, sizeof(address)) == -1 || listen(fd, QUEUE_SIZE) == -1) {
+            perror("error: Cannot listen on the socket");
+            close(fd);
+            return -1;
+        }
+    } else if (connect(fd, (struct sockaddr*) &address, sizeof(address)) == -1) {
+        perror("error: Cannot connect to the server");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+//helper function for --client: send stdin, then print every reply
+static int Client(char* path)
+{
+    int fd = OpenSocket(path, 0);
+    char buffer[LINE_SIZE];
+    ssize_t length;
+    ssize_t sent;
+
+    if (fd == -1) {
+        return -1;
+    }
+    while ((length = read(0, buffer, sizeof(buffer))) > 0) {
+        for (sent = 0; sent < length; ) {
+            ssize_t n = write(fd, buffer + sent, length - sent);
+            if (n <= 0) {
+                perror("error: Cannot send the request");
+                close(fd);
+                return -1;
+            }
+            sent += n;
+        }
+    }
+    shutdown(fd, SHUT_WR);
+    while ((length = read(fd, buffer, sizeof(buffer))) > 0) {
+        fwrite(buffer, 1, length, stdout);
+    }
+    close(fd);
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    static Worker workers[MAX_WORKERS];
+    struct sigaction action;
+    int numWorkers = DEFAULT_WORKERS;
+    int listener, connection;
+    int i;
+
+    if (argc == 3 && strcmp(argv[1], "--client") == 0) {
+        return Client(argv[2]);
+    }
+
+    // options come before the socket path
+    for (i = 1; i < argc && strncmp(argv[i], "--", 2) == 0; i++) {
+        if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+            numWorkers = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--trace-dir") == 0 && i + 1 < argc) {
+            traceDir = argv[++i];
+        } else if (strcmp(argv[i], "--table-core") == 0) {
+            step = UpdateMachineStateFast;
+        } else if (strcmp(argv[i], "--fuse") == 0) {
+            FusionEnabled = 1;
+        } else {
+            fprintf(stderr, "error: unknown option %s\n", argv[i]);
+            perror(USAGE);
+            return -1;
+        }
+    }
+    if (i >= argc || numWorkers < 1 || numWorkers > MAX_WORKERS) {
+        perror(USAGE);
+        return -1;
+    }
+
+    // the base image every job starts from
+    Reset(&baseImage);
+    for (connection = i + 1; connection < argc; connection++) {
+        if (ReadObjectFile(argv[connection], &baseImage) == -1) {
+            perror(USAGE);
+            return -1;
+        }
+    }
+    ClearSymbols();
+
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = FaultHandler;
+    sigaction(SIGFPE, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);   // a client that goes away must not stop the server
+
+    listener = OpenSocket(argv[i], 1);
+    if (listener == -1) {
+        return -1;
+    }
+
+    // warm the machines before the first job arrives
+    for (i = 0; i < numWorkers; i++) {
+        workers[i].machine = malloc(sizeof(MachineState));
+        if (workers[i].machine == NULL) {
+            perror("error: Cannot allocate the machines");
+            return -1;
+        }
+        CopyMachineState(workers[i].machine, &baseImage);
+        if (pthread_create(&workers[i].thread, NULL, WorkerMain, &workers[i]) != 0) {
+            perror("error: Cannot start the workers");
+            return -1;
+        }
+    }
+
+    while (1) {
+        connection = accept(listener, NULL, NULL);
+        if (connection == -1) {
+            perror("error: accept");
+            continue;
+        }
+        pthread_mutex_lock(&queueLock);
+        while (queueCount == QUEUE_SIZE) {
+            pthread_cond_wait(&queueReady, &queueLock);
+        }
+        queue[(queueHead + queueCount) % QUEUE_SIZE] = connection;
+        queueCount++;
+        pthread_cond_broadcast(&queueReady);
+        pthread_mutex_unlock(&queueLock);
+    }
+    return 0;
+}
@@ -0,0 +1,102 @@
+/*
+ * statehash.c: Defines the incrementally maintained machine state hash
+ *
+ * The memory hash is the sum, modulo 2^64, of a mixed term for each
+ * non-zero word and its address. A store subtracts the old word's term and
+ * adds the new one, so it costs two mixes and needs no page hashes to be
+ * recombined; zeroed memory hashes to 0, which is what Reset leaves. The
+ * registers are only mixed in when the hash is asked for.
+ */
+
+#include "statehash.h"
+
+#define STATE_HASH_SEED 0x9E3779B97F4A7C15ULL
+
+int StateHashOn = 0;
+
+// the hash of the state the instruction being written started from (per
+// thread, like the trace format)
+static __thread unsigned long long lineHash;
+
+//helper function for the 64 bit finalizer of splitmix64
+static unsigned long long Mix(unsigned long long x)
+{
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ULL;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBULL;
+    x ^= x >> 31;
+    return x;
+}
+
+//helper function for the term of one word of memory
+static unsigned long long Term(unsigned int address, unsigned short int value)
+{
+    return value != 0 ? Mix(((unsigned long long) address << 16 | value) + STATE_HASH_SEED) : 0;
+}
+
+/*
+ * Recompute CPU->memoryHash from all of memory, after memory was changed
+ * behind the hash's back (loading objects, copying pages in).
+ */
+void StateHashInit(MachineState* CPU)
+{
+    unsigned long long hash = 0;
+    unsigned int i;
+
+    for (i = 0; i <= 0xFFFF; i++) {
+        hash += Term(i, CPU->memory[i]);
+    }
+    CPU->memoryHash = hash;
+}
+
+/*
+ * Account for value being stored at address. Call before the word changes.
+ */
+void StateHashWrite(MachineState* CPU, unsigned short int address, unsigned short int value)
+{
+    CPU->memoryHash += Term(address, value) - Term(address, CPU->memory[address]);
+}
+
+/*
+ * Hash of the PC, PSR, registers, NZP bits and memory of CPU, in constant
+ * time. Equal states have equal hashes whatever their cycle counts.
+ */
+unsigned long long StateHash(MachineState* CPU)
+{
+    unsigned long long hash = CPU->memoryHash;
+
+    hash = Mix(hash + ((unsigned long long) CPU->PC << 48 | (unsigned long long) CPU->PSR << 32
+                       | (unsigned long long) CPU->R[0] << 16 | CPU->R[1]));
+    hash = Mix(hash + ((unsigned long long) CPU->R[2] << 48 | (unsigned long long) CPU->R[3] << 32
+                       | (unsigned long long) CPU->R[4] << 16 | CPU->R[5]));
+    hash = Mix(hash + ((unsigned long long) CPU->NZPVal << 32 | (unsigned long long) CPU->R[6] << 16 | CPU->R[7]));
+    return hash;
+}
+
+/*
+ * Keep the hash current and have WriteOut add the hash of the state each
+ * instruction starts from to its line.
+ */
+void StateHashColumnInit(MachineState* CPU)
+{
+    StateHashOn = 1;
+    StateHashInit(CPU);
+    SimHooks |= HOOK_STATE_HASH;
+}
+
+/*
+ * Hook run before each instruction while the column is on.
+ */
+void StateHashRecord(MachineState* CPU)
+{
+    lineHash = StateHash(CPU);
+}
+
+/*
+ * Write the column recorded for the current instruction, preceded by a space.
+ */
+void StateHashWriteColumn(FILE* output)
+{
+    fprintf(output, " %016llX", lineHash);
+}
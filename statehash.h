@@ -0,0 +1,47 @@
+/*
+ * statehash.h: Declares the incrementally maintained machine state hash
+ */
+
+#ifndef LC4_STATEHASH_H
+#define LC4_STATEHASH_H
+
+#include <stdio.h>
+#include "LC4.h"
+
+// If set, every store keeps CPU->memoryHash current
+extern int StateHashOn;
+
+/*
+ * Recompute CPU->memoryHash from all of memory, after memory was changed
+ * behind the hash's back (loading objects, copying pages in).
+ */
+void StateHashInit(MachineState* CPU);
+
+/*
+ * Account for value being stored at address. Call before the word changes.
+ */
+void StateHashWrite(MachineState* CPU, unsigned short int address, unsigned short int value);
+
+/*
+ * Hash of the PC, PSR, registers, NZP bits and memory of CPU, in constant
+ * time. Equal states have equal hashes whatever their cycle counts.
+ */
+unsigned long long StateHash(MachineState* CPU);
+
+/*
+ * Keep the hash current and have WriteOut add the hash of the state each
+ * instruction starts from to its line.
+ */
+void StateHashColumnInit(MachineState* CPU);
+
+/*
+ * Hook run before each instruction while the column is on.
+ */
+void StateHashRecord(MachineState* CPU);
+
+/*
+ * Write the column recorded for the current instruction, preceded by a space.
+ */
+void StateHashWriteColumn(FILE* output);
+
+#endif
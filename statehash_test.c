@@ -0,0 +1,104 @@
+/*
+ * statehash_test.c: location of main() for the state hash check
+ *
+ * Runs a loop of stores (some of them zeroing words that were set) through
+ * the switch core with the hash column on, and after every instruction
+ * compares the incrementally kept memory hash with one recomputed from all
+ * of memory. Stepping back through the journal must keep it current too,
+ * and states that differ only in their NZP bits must hash differently.
+ * Not built by default: make check
+ */
+
+#include <stddef.h>
+#include "LC4.h"
+#include "journal.h"
+#include "statehash.h"
+
+#define JOURNAL_ENTRIES 4096
+#define STEP_BACK 500
+
+// OS: hand control straight to user code at x0000
+static const unsigned short int osCode[] = {
+    0x9E00,     // x8200  CONST R7, #0
+    0x8000      // x8201  RTI
+};
+
+// user code: 100 passes storing the counter twice and its low bit once,
+// each pass overwriting two of the words the pass before it stored
+static const unsigned short int userCode[] = {
+    0x9200,     // x0000  CONST R1, #0
+    0xD340,     // x0001  HICONST R1, x40        ; R1 = x4000
+    0x9464,     // x0002  CONST R2, #100
+    0x7440,     // x0003  LOOP STR R2, R1, #0
+    0x7441,     // x0004  STR R2, R1, #1
+    0x56A1,     // x0005  AND R3, R2, #1
+    0x767F,     // x0006  STR R3, R1, #-1        ; 0 on every other pass
+    0x1261,     // x0007  ADD R1, R1, #1
+    0x14BF,     // x0008  ADD R2, R2, #-1
+    0x03F9,     // x0009  BRp LOOP
+    0xF0FF      // x000A  TRAP xFF
+};
+
+static MachineState machine;
+static MachineState copy;
+
+//helper function to compare the kept memory hash with a full recompute
+static int Check(const char* when)
+{
+    unsigned long long kept = machine.memoryHash;
+
+    CopyMachineState(&copy, &machine);
+    StateHashInit(&copy);
+    if (copy.memoryHash != kept) {
+        printf("error: memory hash %016llX %s is %016llX when recomputed (cycle %llu, PC %04X)\n",
+               kept, when, copy.memoryHash, machine.cycle, machine.PC);
+        return -1;
+    }
+    return 0;
+}
+
+int main(void)
+{
+    unsigned long long instructions = 0;
+    unsigned long long stores = 0;
+    unsigned long long hash;
+    unsigned short int inst;
+    int status = 0;
+
+    Reset(&machine);
+    memcpy(&machine.memory[0x8200], osCode, sizeof(osCode));
+    memcpy(&machine.memory[0x0000], userCode, sizeof(userCode));
+    StateHashColumnInit(&machine);
+    if (JournalInit(JOURNAL_ENTRIES, JOURNAL_DEFAULT_SNAPSHOTS) == -1) {
+        perror("error: Cannot allocate the journal");
+        return 1;
+    }
+
+    if (Check("after loading") == -1) {
+        return 1;
+    }
+    while (status == 0 && machine.cycle < JOURNAL_ENTRIES) {
+        inst = machine.memory[machine.PC];
+        status = UpdateMachineState(&machine, NULL);
+        instructions++;
+        stores += inst >> 12 == 0x7;
+        if (Check("after an instruction") == -1) {
+            return 1;
+        }
+    }
+
+    JournalStepBack(&machine, STEP_BACK);
+    if (Check("after stepping back") == -1) {
+        return 1;
+    }
+
+    hash = StateHash(&machine);
+    machine.NZPVal ^= 0x7;
+    if (StateHash(&machine) == hash) {
+        printf("error: the state hash ignores the NZP bits\n");
+        return 1;
+    }
+
+    printf("state hash: %llu instructions, %llu stores checked\n", instructions, stores);
+    return 0;
+}
@@ -0,0 +1,174 @@
+/*
+ * stats.c: Defines the live statistics segment and the lc4top reader side
+ *
+ * The run loop compares the cycle count with StatsDue after every
+ * instruction; everything else, including the clock and the trace size,
+ * only happens once per interval. The segment is created once the run is
+ * set up and outlives it, so lc4top can still show how it ended; lc4top
+ * --clean removes the segments of runs that have exited.
+ */
+
+#include <fcntl.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "stats.h"
+#include "loader.h"
+
+unsigned long long StatsDue = ULLONG_MAX;
+
+static StatsBlock* block = NULL;
+static char segmentName[64];
+static unsigned long long statsInterval = STATS_DEFAULT_INTERVAL;
+static unsigned long long lastRetired = 0;
+static struct timespec lastTime;
+
+/*
+ * Create the segment of this process for a run of program, updated every
+ * interval instructions. Returns -1 if it cannot be created.
+ */
+int StatsOpen(const char* program, unsigned long long interval)
+{
+    int fd;
+
+    snprintf(segmentName, sizeof(segmentName), "/" STATS_PREFIX "%d", (int) getpid());
+    fd = shm_open(segmentName, O_CREAT | O_RDWR | O_TRUNC, 0644);
+    if (fd == -1) {
+        return -1;
+    }
+    if (ftruncate(fd, sizeof(StatsBlock)) == -1) {
+        close(fd);
+        shm_unlink(segmentName);
+        return -1;
+    }
+    block = mmap(NULL, sizeof(StatsBlock), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (block == MAP_FAILED) {
+        block = NULL;
+        shm_unlink(segmentName);
+        return -1;
+    }
+
+    // the segment starts out zeroed; the magic goes in last
+    block->version = STATS_VERSION;
+    block->pid = getpid();
+    snprintf(block->program, STATS_PROGRAM_MAX, "%s", program != NULL ? program : "");
+    atomic_store_explicit(&block->status, STATS_RUNNING, memory_order_relaxed);
+    atomic_store_explicit(&block->magic, STATS_MAGIC, memory_order_release);
+
+    statsInterval = interval > 0 ? interval : STATS_DEFAULT_INTERVAL;
+    StatsDue = statsInterval;
+    lastRetired = 0;
+    clock_gettime(CLOCK_MONOTONIC, &lastTime);
+    return 0;
+}
+
+/*
+ * Publish the state of CPU, the size of the trace written to output (may be
+ * NULL) and status (STATS_RUNNING until the final update), then set StatsDue
+ * to the next update.
+ */
+void StatsUpdate(MachineState* CPU, FILE* output, int status)
+{
+    struct timespec now;
+    double seconds;
+    const char* name;
+    unsigned int sequence;
+    int i;
+
+    if (block == NULL) {
+        return;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    seconds = (now.tv_sec - lastTime.tv_sec) + (now.tv_nsec - lastTime.tv_nsec) / 1e9;
+    name = NearestSymbol(CPU->PC);
+
+    // odd while the fields are changing
+    sequence = atomic_load_explicit(&block->sequence, memory_order_relaxed);
+    atomic_store_explicit(&block->sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    atomic_store_explicit(&block->retired, CPU->cycle, memory_order_relaxed);
+    if (output != NULL) {
+        atomic_store_explicit(&block->traceBytes, ftell(output), memory_order_relaxed);
+    }
+    atomic_store_explicit(&block->pc, CPU->PC, memory_order_relaxed);
+    if (seconds > 0) {
+        atomic_store_explicit(&block->mipsHundredths,
+                              (CPU->cycle - lastRetired) / seconds / 1e4, memory_order_relaxed);
+    }
+    atomic_store_explicit(&block->status, status, memory_order_relaxed);
+    for (i = 0; i < STATS_SYMBOL_MAX - 1 && name != NULL && name[i] != '\0'; i++) {
+        atomic_store_explicit(&block->symbol[i], name[i], memory_order_relaxed);
+    }
+    atomic_store_explicit(&block->symbol[i], '\0', memory_order_relaxed);
+
+    atomic_store_explicit(&block->sequence, sequence + 2, memory_order_release);
+
+    lastRetired = CPU->cycle;
+    lastTime = now;
+    StatsDue = CPU->cycle + statsInterval;
+}
+
+/*
+ * Stop publishing, leaving the segment with the final update for lc4top to
+ * show and reap once this process has exited.
+ */
+void StatsClose(void)
+{
+    if (block == NULL) {
+        return;
+    }
+    munmap(block, sizeof(StatsBlock));
+    block = NULL;
+    StatsDue = ULLONG_MAX;
+}
+
+/*
+ * Remove the segment of this process, for a run that failed to start.
+ */
+void StatsRemove(void)
+{
+    if (block == NULL) {
+        return;
+    }
+    StatsClose();
+    shm_unlink(segmentName);
+}
+
+/*
+ * Take a consistent copy of a mapped segment. Returns -1 if it is
+ * not a stats segment of this version.
+ */
+int StatsRead(const StatsBlock* segment, StatsSnapshot* snapshot)
+{
+    unsigned int before, after;
+    int i;
+
+    if (atomic_load_explicit(&segment->magic, memory_order_acquire) != STATS_MAGIC
+        || segment->version != STATS_VERSION) {
+        return -1;
+    }
+    snapshot->pid = segment->pid;
+    snprintf(snapshot->program, STATS_PROGRAM_MAX, "%.*s", STATS_PROGRAM_MAX - 1, segment->program);
+
+    // retry while the simulator is in the middle of an update
+    do {
+        before = atomic_load_explicit(&segment->sequence, memory_order_acquire);
+        snapshot->retired = atomic_load_explicit(&segment->retired, memory_order_relaxed);
+        snapshot->traceBytes = atomic_load_explicit(&segment->traceBytes, memory_order_relaxed);
+        snapshot->pc = atomic_load_explicit(&segment->pc, memory_order_relaxed);
+        snapshot->mips = atomic_load_explicit(&segment->mipsHundredths, memory_order_relaxed) / 100.0;
+        snapshot->status = atomic_load_explicit(&segment->status, memory_order_relaxed);
+        for (i = 0; i < STATS_SYMBOL_MAX; i++) {
+            snapshot->symbol[i] = atomic_load_explicit(&segment->symbol[i], memory_order_relaxed);
+        }
+        atomic_thread_fence(memory_order_acquire);
+        after = atomic_load_explicit(&segment->sequence, memory_order_relaxed);
+    } while ((before & 1) || before != after);
+
+    snapshot->symbol[STATS_SYMBOL_MAX - 1] = '\0';
+    return 0;
+}
@@ -0,0 +1,92 @@
+/*
+ * stats.h: Declares the live statistics segment and the lc4top reader side
+ */
+
+#ifndef LC4_STATS_H
+#define LC4_STATS_H
+
+#include <stdio.h>
+#include <stdatomic.h>
+#include <sys/types.h>
+#include "LC4.h"
+
+// Segments are named STATS_PREFIX followed by the pid; lc4top lists them in STATS_DIRECTORY
+#define STATS_PREFIX "lc4stats."
+#define STATS_DIRECTORY "/dev/shm"
+#define STATS_MAGIC 0x4C433453          // "LC4S"
+#define STATS_VERSION 1
+
+// Instructions between updates when none are given
+#define STATS_DEFAULT_INTERVAL 1000000
+
+#define STATS_SYMBOL_MAX 32
+#define STATS_PROGRAM_MAX 64
+
+// The run has not stopped yet
+#define STATS_RUNNING -2
+
+/*
+ * The segment. The simulator is the only writer; every field is updated with
+ * relaxed atomics, and sequence is odd while an update is under way so a
+ * reader can take a consistent copy without a lock.
+ */
+typedef struct {
+    atomic_uint magic;
+    unsigned int version;
+    pid_t pid;
+    char program[STATS_PROGRAM_MAX];                // last object file
+    atomic_uint sequence;
+    atomic_ullong retired;                          // instructions retired
+    atomic_ullong traceBytes;                       // bytes of trace written
+    atomic_uint pc;
+    atomic_uint mipsHundredths;                     // MIPS over the last interval, x100
+    atomic_int status;                              // last UpdateMachineState code
+    atomic_char symbol[STATS_SYMBOL_MAX];           // nearest symbol at or below pc
+} StatsBlock;
+
+// A plain copy of the segment, as lc4top sees it
+typedef struct {
+    pid_t pid;
+    char program[STATS_PROGRAM_MAX];
+    unsigned long long retired;
+    unsigned long long traceBytes;
+    unsigned int pc;
+    double mips;
+    int status;
+    char symbol[STATS_SYMBOL_MAX];
+} StatsSnapshot;
+
+// Cycle at which the run loop should call StatsUpdate next; never, without a segment
+extern unsigned long long StatsDue;
+
+/*
+ * Create the segment of this process for a run of program, updated every
+ * interval instructions. Returns -1 if it cannot be created.
+ */
+int StatsOpen(const char* program, unsigned long long interval);
+
+/*
+ * Publish the state of CPU, the size of the trace written to output (may be
+ * NULL) and status (STATS_RUNNING until the final update), then set StatsDue
+ * to the next update.
+ */
+void StatsUpdate(MachineState* CPU, FILE* output, int status);
+
+/*
+ * Stop publishing, leaving the segment with the final update for lc4top to
+ * show and reap once this process has exited.
+ */
+void StatsClose(void);
+
+/*
+ * Remove the segment of this process, for a run that failed to start.
+ */
+void StatsRemove(void);
+
+/*
+ * Take a consistent copy of a mapped segment. Returns -1 if it is
+ * not a stats segment of this version.
+ */
+int StatsRead(const StatsBlock* segment, StatsSnapshot* snapshot);
+
+#endif
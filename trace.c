@@ -2,52 +2,462 @@
  * trace.c: location of main() to start the simulator
  */
 
+#include <unistd.h>
 #include "loader.h"
+#include "profile.h"
+#include "trap.h"
+#include "devices.h"
+#include "journal.h"
+#include "fusion.h"
+#include "tracefile.h"
+#include "fastcore.h"
+#include "pipeline.h"
+#include "cache.h"
+#include "breakpoint.h"
+#include "multicore.h"
+#include "disasm.h"
+#include "regen.h"
+#include "stats.h"
+#include "memo.h"
+#include "dump.h"
+#include "statehash.h"
+
+#define MAX_BREAK_OPTIONS 64
+
+#define USAGE "Please enter ./trace [options] output_filename.txt first.obj ...\n"
 
 // Global variable defining the current state of the machine
 MachineState* CPU;
 
+//helper function to open a trace file, starting it with the magic if binary
+static FILE* OpenTrace(char* filename)
+{
+    FILE* output_p = fopen(filename, "w");
+
+    if (output_p == NULL) {
+        perror("error: Cannot open the output file");
+        return NULL;
+    }
+    if (TraceFormat == TRACE_BINARY) {
+        fwrite(TRACE_MAGIC, 1, TRACE_MAGIC_LENGTH, output_p);
+    }
+    return output_p;
+}
+
+//helper function to name the trace of one core: out.txt becomes out.core1.txt
+static void CoreTraceName(char* filename, int core, char* name, size_t size)
+{
+    char* dot = strrchr(filename, '.');
+    char* slash = strrchr(filename, '/');
+
+    if (dot == NULL || (slash != NULL && dot < slash)) {
+        snprintf(name, size, "%s.core%d", filename, core);
+    } else {
+        snprintf(name, size, "%.*s.core%d%s", (int) (dot - filename), filename, core, dot);
+    }
+}
+
 int main(int argc, char** argv)
 {
     MachineState machine;
-    FILE * output_p;
+    FILE * output_p = NULL;
     int i;
-    unsigned short line;
+    int traceOn = 1;
+    int status;
+    int (*step)(MachineState*, FILE*) = UpdateMachineState;
+    unsigned int journalEntries = 0;
+    unsigned int journalSnapshots = JOURNAL_DEFAULT_SNAPSHOTS;
+    unsigned long long stepBack = 0;
+    int runBackTo = -1;
+    int timing = 0;
+    PipelineConfig pipeline;
+    CacheConfig cache;
+    int caches = 0;     // bit 0 instruction, bit 1 data cache configured
+    int cacheKind;
+    int cacheBits;
+    int breakKinds[MAX_BREAK_OPTIONS];
+    char* breakLocations[MAX_BREAK_OPTIONS];
+    int numBreaks = 0;
+    char* breakFile = NULL;
+    int numCores = 0;
+    unsigned int quantum = DEFAULT_QUANTUM;
+    int devicesOn = 0;
+    int disasm = 0;
+    int stateHash = 0;
+    unsigned long long regenInterval = 0;
+    int regenThreads = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned long long statsInterval = 0;
+    char* memoDir = NULL;
+    int memoHit = 0;
+    unsigned long long retired = 0;
+    char* dumpName = NULL;
+    int dumpFormat = DUMP_TEXT;
+    FILE* dump_p;
+    long traceStart = 0;
+    char* outputName = NULL;
+    char* program = NULL;
+    char coreName[FILENAME_MAX];
+    FILE* coreOutputs[MAX_CORES];
+    int coreStatuses[MAX_CORES];
     CPU = &machine;
 
+    PipelineDefaults(&pipeline);
+
+    // options come before the output file name
+    for (i = 1; i < argc && strncmp(argv[i], "--", 2) == 0; i++) {
+        if (strcmp(argv[i], "--no-trace") == 0) {   // run without writing a trace
+            traceOn = 0;
+        } else if (strcmp(argv[i], "--binary-trace") == 0) {   // fixed size records instead of text
+            TraceFormat = TRACE_BINARY;
+        } else if (strcmp(argv[i], "--hle") == 0) {     // emulate the standard traps
+            TrapMode = TRAP_MODE_HLE;
+        } else if (strcmp(argv[i], "--hle-strict") == 0) {  // ...unless the OS must be traced
+            TrapMode = TRAP_MODE_HLE_STRICT;
+        } else if (strcmp(argv[i], "--table-core") == 0) {    // pre-decoded handler table
+            step = UpdateMachineStateFast;
+        } else if (strcmp(argv[i], "--fuse") == 0) {   // run common idioms as one operation
+            FusionEnabled = 1;
+        } else if (strcmp(argv[i], "--devices") == 0) {    // console and timer registers
+            InitDevices();
+            devicesOn = 1;
+        } else if (strcmp(argv[i], "--input") == 0 && i + 1 < argc) {  // console input file or pipe
+            if (ConsoleOpenInput(argv[++i]) == -1) {
+                return -1;
+            }
+        } else if (strcmp(argv[i], "--journal") == 0 && i + 1 < argc) {   // undo ring ENTRIES[:SNAPSHOTS]
+            sscanf(argv[++i], "%u:%u", &journalEntries, &journalSnapshots);
+        } else if (strcmp(argv[i], "--step-back") == 0 && i + 1 < argc) {     // show the state N cycles before the end
+            stepBack = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--run-back-to") == 0 && i + 1 < argc) {   // ...or the last time PC (hex) was reached
+            runBackTo = strtol(argv[++i], NULL, 16) & 0xFFFF;
+        } else if (strcmp(argv[i], "--timing") == 0) {     // pipelined datapath cycle estimate
+            timing = 1;
+        } else if (strcmp(argv[i], "--predictor") == 0 && i + 1 < argc) {     // not-taken, taken or bimodal[:BITS]
+            i++;
+            if (strcmp(argv[i], "taken") == 0) {
+                pipeline.predictor = PREDICT_TAKEN;
+            } else if (strncmp(argv[i], "bimodal", 7) == 0) {
+                pipeline.predictor = PREDICT_BIMODAL;
+                sscanf(argv[i], "bimodal:%u", &pipeline.predictorBits);
+            } else {
+                pipeline.predictor = PREDICT_NOT_TAKEN;
+            }
+        } else if (strcmp(argv[i], "--mispredict-penalty") == 0 && i + 1 < argc) {
+            pipeline.mispredictPenalty = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--mul-latency") == 0 && i + 1 < argc) {
+            pipeline.mulLatency = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--div-latency") == 0 && i + 1 < argc) {
+            pipeline.divLatency = atoi(argv[++i]);
+        } else if ((strcmp(argv[i], "--icache") == 0 || strcmp(argv[i], "--dcache") == 0
+                    || strcmp(argv[i], "--cache") == 0) && i + 1 < argc) {    // SIZE:LINE:ASSOC[:lru|random] in words
+            if (CacheParse(argv[i + 1], &cache) == -1) {
+                fprintf(stderr, "error: bad cache geometry %s\n", argv[i + 1]);
+                return -1;
+            }
+            cacheKind = argv[i][2] == 'i' ? CACHE_INSTRUCTION : argv[i][2] == 'd' ? CACHE_DATA : CACHE_UNIFIED;
+            cacheBits = cacheKind == CACHE_INSTRUCTION ? 1 : cacheKind == CACHE_DATA ? 2 : 3;
+            if (caches & cacheBits) {
+                fprintf(stderr, "error: %s repeats a cache that is already configured\n", argv[i]);
+                return -1;
+            }
+            if (CacheInit(cacheKind, &cache) == -1) {
+                perror("error: Cannot allocate the cache model");
+                return -1;
+            }
+            caches |= cacheBits;
+            i++;
+        } else if ((strcmp(argv[i], "--break") == 0 || strcmp(argv[i], "--watch") == 0
+                    || strcmp(argv[i], "--watch-read") == 0) && i + 1 < argc) {     // label or hex address
+            if (numBreaks == MAX_BREAK_OPTIONS) {
+                fprintf(stderr, "error: too many breakpoints, use --breakpoints\n");
+                return -1;
+            }
+            breakKinds[numBreaks] = argv[i][2] == 'b' ? BREAK_EXECUTE : argv[i][7] == '-' ? BREAK_READ : BREAK_WRITE;
+            breakLocations[numBreaks++] = argv[++i];
+        } else if (strcmp(argv[i], "--breakpoints") == 0 && i + 1 < argc) {     // command file
+            breakFile = argv[++i];
+        } else if (strcmp(argv[i], "--cores") == 0 && i + 1 < argc) {     // N cores sharing memory
+            numCores = atoi(argv[++i]);
+            if (numCores < 1 || numCores > MAX_CORES) {
+                fprintf(stderr, "error: --cores takes 1 to %d\n", MAX_CORES);
+                return -1;
+            }
+        } else if (strcmp(argv[i], "--quantum") == 0 && i + 1 < argc) {   // instructions per turn
+            quantum = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--free-running") == 0) {     // cores run at once, not reproducible
+            quantum = 0;
+        } else if (strcmp(argv[i], "--disasm") == 0) {    // add the instruction in assembly to each line
+            disasm = 1;
+        } else if (strcmp(argv[i], "--state-hash") == 0) {    // add the hash of the machine state to each line
+            stateHash = 1;
+        } else if (strcmp(argv[i], "--parallel-trace") == 0) {    // checkpoint, then trace segments in parallel
+            regenInterval = REGEN_DEFAULT_INTERVAL;
+            if (i + 1 < argc && argv[i + 1][0] >= '0' && argv[i + 1][0] <= '9') {     // optional CYCLES between checkpoints
+                regenInterval = strtoull(argv[++i], NULL, 0);
+            }
+        } else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {     // threads for --parallel-trace
+            regenThreads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--result-cache") == 0 && i + 1 < argc) {     // reuse results of identical runs
+            memoDir = argv[++i];
+        } else if (strcmp(argv[i], "--dump-memory") == 0 && i + 1 < argc) {     // final state and non-zero memory
+            dumpName = argv[++i];
+        } else if (strcmp(argv[i], "--binary-dump") == 0) {     // ...as ranges of words instead of text
+            dumpFormat = DUMP_BINARY;
+        } else if (strcmp(argv[i], "--stats") == 0) {     // publish progress for lc4top
+            statsInterval = STATS_DEFAULT_INTERVAL;
+            if (i + 1 < argc && argv[i + 1][0] >= '0' && argv[i + 1][0] <= '9') {     // optional instructions between updates
+                statsInterval = strtoull(argv[++i], NULL, 0);
+            }
+        } else {
+            fprintf(stderr, "error: unknown option %s\n", argv[i]);
+            perror(USAGE);
+            return -1;
+        }
+    }
+
     // check if enough number of command line arguments given
-    if (argc < 3) { // If missing one of the necessary components, return error message
-        perror("Please enter ./trace output_filename.txt first.obj ...\n");
+    if (argc - i < (traceOn ? 2 : 1)) { // If missing one of the necessary components, return error message
+        perror(USAGE);
+        return -1;
+    }
+
+    // reverse stepping needs a journal, and cannot undo what emulated traps or devices do
+    if ((stepBack > 0 || runBackTo >= 0) && journalEntries == 0) {
+        journalEntries = JOURNAL_DEFAULT_ENTRIES;
+    }
+    if (journalEntries > 0 && (TrapMode != TRAP_MODE_OS || devicesOn)) {
+        fprintf(stderr, "error: --journal cannot be combined with --hle or --devices\n");
+        return -1;
+    }
+
+    // the other tools keep per-run state of a single machine, and free-running
+    // cores would race on the console
+    if (numCores > 0 && (journalEntries > 0 || timing || caches || numBreaks > 0 || breakFile != NULL)) {
+        fprintf(stderr, "error: --cores cannot be combined with the journal, timing, cache or breakpoint options\n");
+        return -1;
+    }
+    if (numCores > 0 && quantum == 0 && (devicesOn || TrapMode != TRAP_MODE_OS)) {
+        fprintf(stderr, "error: --free-running cannot be combined with --devices or --hle\n");
+        return -1;
+    }
+
+    // segments are re-run from checkpoints, so nothing may depend on host input
+    // or keep state of its own across the run
+    if (regenInterval > 0 && (!traceOn || numCores > 0 || journalEntries > 0 || timing || caches || numBreaks > 0
+                              || breakFile != NULL || devicesOn || TrapMode != TRAP_MODE_OS)) {
+        fprintf(stderr, "error: --parallel-trace needs a trace and cannot be combined with --cores, --devices,\n"
+                        "       --hle or the journal, timing, cache or breakpoint options\n");
+        return -1;
+    }
+    // a cached run only has its trace and final state to give back
+    if (memoDir != NULL && (numCores > 0 || journalEntries > 0 || timing || caches || numBreaks > 0
+                            || breakFile != NULL || devicesOn || TrapMode != TRAP_MODE_OS)) {
+        fprintf(stderr, "error: --result-cache cannot be combined with --cores, --devices, --hle\n"
+                        "       or the journal, timing, cache or breakpoint options\n");
+        return -1;
+    }
+    // the column is text only, and cores share one memory but not its hash
+    if (stateHash && (TraceFormat == TRACE_BINARY || numCores > 0)) {
+        fprintf(stderr, "error: --state-hash cannot be combined with --binary-trace or --cores\n");
+        return -1;
+    }
+    if (dumpName != NULL && numCores > 0) {
+        fprintf(stderr, "error: --dump-memory cannot be combined with --cores\n");
+        return -1;
+    }
+    if (dumpFormat == DUMP_BINARY && dumpName == NULL) {
+        fprintf(stderr, "error: --binary-dump needs --dump-memory\n");
         return -1;
     }
-    
+    if (regenThreads < 1) {
+        regenThreads = 1;
+    }
+
     Reset(CPU);
-    
-    output_p = fopen(argv[1], "w");   // open output_filename for writing
 
-    for (i = 2; i < argc; i++) {
+    if (traceOn) {
+        outputName = argv[i++];
+        if (numCores == 0) {
+            output_p = OpenTrace(outputName);   // open output_filename for writing
+            if (output_p == NULL) {
+                return -1;
+            }
+        }
+    }
+
+    // runs are known by their last object; the first is usually the OS
+    program = i < argc ? argv[argc - 1] : NULL;
+    for (; i < argc; i++) {
         if (ReadObjectFile(argv[i], CPU) == -1) { // If obj file doesn't exist, return error message
-            perror("Please enter ./trace output_filename.txt first.obj ...\n");
+            perror(USAGE);
             return -1;
         }
     }
 
-    /*for (i = 0; i < 0xFFFF; i++) {  //cycle through all memory addresses
-        line = CPU->memory[i];
-        if (line != 0) {
-            fprintf(output_p,"address: %05d contents: 0x%04X\n", i, line); //add non-zero values to output file
-        }
-    }*/
-    
     // CPU->PC = 0;
 
-    while (1) {
-        // program should exit upon errors or ending
-        if (UpdateMachineState(CPU, output_p) != 0) {
-            break;
+    // labels are only known once the objects are loaded
+    if (disasm) {
+        if (DisasmInit() == -1) {
+            perror("error: Cannot allocate the disassembly table");
+            return -1;
+        }
+        DisasmColumn = 1;
+    }
+    if (stateHash) {
+        StateHashColumnInit(CPU);
+    }
+    for (i = 0; i < numBreaks; i++) {
+        if (BreakpointAdd(breakKinds[i], breakLocations[i]) == -1) {
+            fprintf(stderr, "error: unknown location %s\n", breakLocations[i]);
+            return -1;
+        }
+    }
+    if (breakFile != NULL && BreakpointLoad(breakFile) == -1) {
+        return -1;
+    }
+
+    // breakpoints need to see every instruction, so they get the checked engine
+    if (BreakpointsArmed()) {
+        CheckedStep = step;
+        step = UpdateMachineStateChecked;
+        FusionEnabled = 0;
+    }
+
+    if (journalEntries > 0 && JournalInit(journalEntries, journalSnapshots) == -1) {
+        perror("error: Cannot allocate the journal");
+        return -1;
+    }
+
+    if (timing && PipelineInit(&pipeline) == -1) {
+        perror("error: Cannot allocate the timing model");
+        return -1;
+    }
+
+    // each core writes its own trace
+    for (i = 0; i < numCores; i++) {
+        coreOutputs[i] = NULL;
+        if (traceOn) {
+            CoreTraceName(outputName, i, coreName, sizeof(coreName));
+            coreOutputs[i] = OpenTrace(coreName);
+            if (coreOutputs[i] == NULL) {
+                return -1;
+            }
+        }
+    }
+
+    // created last, so a run that fails to start leaves no segment behind
+    if (statsInterval > 0 && StatsOpen(program, statsInterval) == -1) {
+        perror("error: Cannot create the statistics segment");
+        return -1;
+    }
+
+    // an identical run may already be in the cache
+    if (memoDir != NULL) {
+        traceStart = output_p != NULL ? ftell(output_p) : 0;
+        memoHit = MemoLookup(memoDir, CPU, traceOn, output_p, &status);
+    }
+
+    ProfileStart();
+    if (memoHit) {
+        // the trace and final state came from the cache
+    } else if (numCores > 0) {
+        if (RunCores(CPU, numCores, quantum, step, coreOutputs, coreStatuses) == -1) {
+            perror("error: Cannot start the cores");
+            StatsRemove();
+            return -1;
+        }
+        status = 0;
+    } else if (regenInterval > 0) {
+        status = RegenerateTrace(CPU, step, output_p, regenInterval, regenThreads);
+        if (status == -1) {
+            perror("error: Cannot regenerate the trace");
+            StatsRemove();
+            return -1;
+        }
+    } else {
+        while (1) {
+            // program should exit upon errors or ending
+            status = step(CPU, output_p);
+            if (status != 0) {
+                break;
+            }
+            if (CPU->cycle >= StatsDue) {
+                StatsUpdate(CPU, output_p, STATS_RUNNING);
+            }
+        }
+    }
+    if (!memoHit) {
+        retired = CPU->cycle;
+        for (i = 0; i < numCores; i++) {
+            retired += Core(i)->cycle;
+        }
+    }
+    ProfileStop(retired);
+    StatsUpdate(numCores > 0 ? Core(0) : CPU, numCores > 0 ? coreOutputs[0] : output_p, status);
+
+    if (memoDir != NULL && !memoHit) {
+        if (output_p != NULL) {
+            fflush(output_p);
+        }
+        if (MemoStore(CPU, status, output_p != NULL ? outputName : NULL, traceStart) == -1) {
+            perror("error: Cannot save the run in the result cache");
+        }
+    }
+
+    for (i = 0; i < numCores; i++) {
+        fprintf(stderr, "core %d stopped with status %d at:\n", i, coreStatuses[i]);
+        PrintState(Core(i), stderr);
+        if (coreOutputs[i] != NULL) {
+            fclose(coreOutputs[i]);
+        }
+    }
+
+    if (dumpName != NULL) {
+        dump_p = fopen(dumpName, "w");
+        if (dump_p == NULL || WriteDump(CPU, status, dumpFormat, dump_p) == -1) {
+            perror("error: Cannot write the memory dump");
         }
+        if (dump_p != NULL) {
+            fclose(dump_p);
+        }
+    }
+
+    if (status == BREAK_STOPPED) {
+        PrintState(CPU, stderr);
+    }
+
+    // report the state leading up to the end of the run
+    if (stepBack > 0 || runBackTo >= 0) {
+        fprintf(stderr, "stopped with status %d at:\n", status);
+        PrintState(CPU, stderr);
+        if (stepBack > 0) {
+            fprintf(stderr, "stepped back %llu cycles to:\n", JournalStepBack(CPU, stepBack));
+            PrintState(CPU, stderr);
+        }
+        if (runBackTo >= 0) {
+            if (JournalRunBackTo(CPU, runBackTo) == 0) {
+                fprintf(stderr, "ran back to PC %04X:\n", runBackTo);
+                PrintState(CPU, stderr);
+            } else {
+                fprintf(stderr, "PC %04X is not in the journal\n", runBackTo);
+            }
+        }
+    }
+
+    if (timing) {
+        PipelineReport(stderr);
     }
 
-    fclose(output_p);     // close output file
+    if (caches) {
+        CacheReport(stderr);
+    }
+
+    ConsoleFlush();     // buffered console output
+    if (output_p != NULL) {
+        fclose(output_p);     // close output file
+    }
+    ProfileReport(stderr);  // JSON summary of where the time went
+    StatsClose();
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,320 @@
+/*
+ * tracediff.c: location of main() for the streaming trace comparison tool
+ *
+ * Compares two traces (text as written by WriteOut, or binary as written with
+ * --binary-trace, in any combination) and stops at the first divergence.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "tracefile.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define USAGE "Please enter ./tracediff [-C lines] reference_trace simulator_trace\n"
+#define DEFAULT_CONTEXT 3
+#define NUM_FIELDS 10
+
+// names of the fields of a trace line, in WriteOut order
+static const char* fieldNames[NUM_FIELDS] = {
+    "PC", "instruction", "regFile_WE", "rdMux_CTL", "regInputVal",
+    "NZP_WE", "NZPVal", "DATA_WE", "dmemAddr", "dmemValue"
+};
+
+typedef struct {
+    char* name;
+    const unsigned char* data;
+    size_t size;
+    size_t start;       // offset of the first line (past the binary header)
+    int binary;
+} TraceFile;
+
+// position of one line in a trace
+typedef struct {
+    TraceFile* trace;
+    size_t offset;
+} Cursor;
+
+//helper function to map a trace file and work out its format
+static int MapTrace(char* name, TraceFile* trace)
+{
+    struct stat info;
+    int fd = open(name, O_RDONLY);
+
+    if (fd < 0 || fstat(fd, &info) < 0) {
+        perror(name);
+        return -1;
+    }
+
+    trace->name = name;
+    trace->size = info.st_size;
+    trace->data = (const unsigned char*) "";
+    if (trace->size > 0) {
+        trace->data = mmap(NULL, trace->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (trace->data == MAP_FAILED) {
+            perror(name);
+            close(fd);
+            return -1;
+        }
+        madvise((void*) trace->data, trace->size, MADV_SEQUENTIAL);
+    }
+    close(fd);
+
+    trace->binary = trace->size >= TRACE_MAGIC_LENGTH && memcmp(trace->data, TRACE_MAGIC, TRACE_MAGIC_LENGTH) == 0;
+    trace->start = trace->binary ? TRACE_MAGIC_LENGTH : 0;
+    return 0;
+}
+
+//helper function to find the first offset at which a and b differ (n if none)
+static size_t FirstDifference(const unsigned char* a, const unsigned char* b, size_t n)
+{
+    size_t i = 0;
+
+#ifdef __SSE2__
+    // 64 bytes per step, 16 bytes per vector compare
+    for (; i + 64 <= n; i += 64) {
+        __m128i eq0 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) (a + i)), _mm_loadu_si128((const __m128i*) (b + i)));
+        __m128i eq1 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) (a + i + 16)), _mm_loadu_si128((const __m128i*) (b + i + 16)));
+        __m128i eq2 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) (a + i + 32)), _mm_loadu_si128((const __m128i*) (b + i + 32)));
+        __m128i eq3 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) (a + i + 48)), _mm_loadu_si128((const __m128i*) (b + i + 48)));
+        __m128i all = _mm_and_si128(_mm_and_si128(eq0, eq1), _mm_and_si128(eq2, eq3));
+        if (_mm_movemask_epi8(all) != 0xFFFF) {
+            break;
+        }
+    }
+#endif
+
+    for (; i < n; i++) {
+        if (a[i] != b[i]) {
+            break;
+        }
+    }
+    return i;
+}
+
+//helper function to count the newlines in p[0..n)
+static unsigned long long CountLines(const unsigned char* p, size_t n)
+{
+    unsigned long long lines = 0;
+    size_t i = 0;
+
+#ifdef __SSE2__
+    __m128i newline = _mm_set1_epi8('\n');
+    for (; i + 16 <= n; i += 16) {
+        lines += __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) (p + i)), newline)));
+    }
+#endif
+
+    for (; i < n; i++) {
+        lines += p[i] == '\n';
+    }
+    return lines;
+}
+
+//helper function to copy the line at cursor into line (null terminated), -1 past the end
+static int CursorLine(Cursor* cursor, char* line)
+{
+    TraceFile* trace = cursor->trace;
+    const unsigned char* end;
+    int length;
+
+    if (trace->binary) {
+        if (cursor->offset + sizeof(TraceRecord) > trace->size) {
+            return -1;
+        }
+        length = FormatTraceRecord((const TraceRecord*) (trace->data + cursor->offset), line) - 1;
+    } else {
+        if (cursor->offset >= trace->size) {
+            return -1;
+        }
+        end = memchr(trace->data + cursor->offset, '\n', trace->size - cursor->offset);
+        length = (end != NULL ? (size_t) (end - trace->data) : trace->size) - cursor->offset;
+        if (length > TRACE_LINE_MAX - 1) {
+            length = TRACE_LINE_MAX - 1;
+        }
+        memcpy(line, trace->data + cursor->offset, length);
+    }
+    line[length] = '\0';
+    return length;
+}
+
+//helper function to move cursor to the next line
+static void CursorNext(Cursor* cursor)
+{
+    TraceFile* trace = cursor->trace;
+    const unsigned char* end;
+
+    if (trace->binary) {
+        cursor->offset += sizeof(TraceRecord);
+        return;
+    }
+    end = memchr(trace->data + cursor->offset, '\n', trace->size - cursor->offset);
+    cursor->offset = end != NULL ? (size_t) (end - trace->data) + 1 : trace->size;
+}
+
+//helper function to move cursor to the previous line, 0 if it is the first
+static int CursorPrev(Cursor* cursor)
+{
+    TraceFile* trace = cursor->trace;
+    size_t i;
+
+    if (cursor->offset <= trace->start) {
+        return 0;
+    }
+    if (trace->binary) {
+        cursor->offset -= sizeof(TraceRecord);
+        return 1;
+    }
+    for (i = cursor->offset - 1; i > 0 && trace->data[i - 1] != '\n'; i--) {
+    }
+    cursor->offset = i;
+    return 1;
+}
+
+//helper function to split a line into its space separated fields
+static int SplitFields(char* line, char** fields, int max)
+{
+    int n = 0;
+    char* token = strtok(line, " ");
+
+    while (token != NULL && n < max) {
+        fields[n++] = token;
+        token = strtok(NULL, " ");
+    }
+    return n;
+}
+
+//helper function to print which fields of the two lines differ
+static void ReportFields(const char* lineA, const char* lineB)
+{
+    char copyA[TRACE_LINE_MAX];
+    char copyB[TRACE_LINE_MAX];
+    char* fieldsA[NUM_FIELDS + 8];
+    char* fieldsB[NUM_FIELDS + 8];
+    int numA, numB, i;
+
+    strcpy(copyA, lineA);
+    strcpy(copyB, lineB);
+    numA = SplitFields(copyA, fieldsA, NUM_FIELDS + 8);
+    numB = SplitFields(copyB, fieldsB, NUM_FIELDS + 8);
+
+    for (i = 0; i < numA || i < numB; i++) {
+        if (i < numA && i < numB && strcmp(fieldsA[i], fieldsB[i]) == 0) {
+            continue;
+        }
+        printf("  %s: %s vs %s\n", i < NUM_FIELDS ? fieldNames[i] : "extra field",
+               i < numA ? fieldsA[i] : "(missing)", i < numB ? fieldsB[i] : "(missing)");
+    }
+}
+
+//helper function to report the divergence at line number lineNumber (1 based)
+static void Report(Cursor a, Cursor b, unsigned long long lineNumber, int context)
+{
+    char lineA[TRACE_LINE_MAX];
+    char lineB[TRACE_LINE_MAX];
+    Cursor before = a;
+    int lengthA, lengthB, i, shown;
+
+    lengthA = CursorLine(&a, lineA);
+    lengthB = CursorLine(&b, lineB);
+
+    printf("first difference at line %llu (cycle %llu)\n", lineNumber, lineNumber - 1);
+    if (lengthA < 0 || lengthB < 0) {
+        printf("  %s ends here\n", lengthA < 0 ? a.trace->name : b.trace->name);
+    } else {
+        ReportFields(lineA, lineB);
+    }
+
+    // common lines leading up to the difference
+    for (shown = 0; shown < context && CursorPrev(&before); shown++) {
+    }
+    for (i = 0; i < shown; i++) {
+        CursorLine(&before, lineA);
+        printf("  %s\n", lineA);
+        CursorNext(&before);
+    }
+
+    // the differing line and what follows it in each trace
+    for (i = 0; i <= context && CursorLine(&a, lineA) >= 0; i++) {
+        printf("< %s\n", lineA);
+        CursorNext(&a);
+    }
+    for (i = 0; i <= context && CursorLine(&b, lineB) >= 0; i++) {
+        printf("> %s\n", lineB);
+        CursorNext(&b);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    TraceFile traceA, traceB;
+    Cursor a, b;
+    char lineA[TRACE_LINE_MAX];
+    char lineB[TRACE_LINE_MAX];
+    unsigned long long lineNumber;
+    int context = DEFAULT_CONTEXT;
+    int lengthA, lengthB;
+    size_t n, offset;
+    int i = 1;
+
+    if (argc > 2 && strcmp(argv[1], "-C") == 0) {
+        context = atoi(argv[2]);
+        i = 3;
+    }
+    if (argc - i != 2) {
+        perror(USAGE);
+        return 2;
+    }
+    if (MapTrace(argv[i], &traceA) == -1 || MapTrace(argv[i + 1], &traceB) == -1) {
+        return 2;
+    }
+
+    a.trace = &traceA;
+    b.trace = &traceB;
+
+    if (traceA.binary == traceB.binary) {
+        // same format: compare raw bytes, then find the line holding the difference
+        n = traceA.size < traceB.size ? traceA.size : traceB.size;
+        offset = FirstDifference(traceA.data, traceB.data, n);
+        if (offset == n && traceA.size == traceB.size) {
+            return 0;
+        }
+
+        if (traceA.binary) {
+            offset -= (offset - TRACE_MAGIC_LENGTH) % sizeof(TraceRecord);
+            lineNumber = (offset - TRACE_MAGIC_LENGTH) / sizeof(TraceRecord) + 1;
+        } else {
+            while (offset > 0 && traceA.data[offset - 1] != '\n') {
+                offset--;
+            }
+            lineNumber = CountLines(traceA.data, offset) + 1;
+        }
+        a.offset = b.offset = offset;
+        Report(a, b, lineNumber, context);
+        return 1;
+    }
+
+    // binary against text: format each record and compare it with the text line
+    a.offset = traceA.start;
+    b.offset = traceB.start;
+    for (lineNumber = 1; ; lineNumber++) {
+        lengthA = CursorLine(&a, lineA);
+        lengthB = CursorLine(&b, lineB);
+        if (lengthA < 0 && lengthB < 0) {
+            return 0;
+        }
+        if (lengthA != lengthB || memcmp(lineA, lineB, lengthA) != 0) {
+            Report(a, b, lineNumber, context);
+            return 1;
+        }
+        CursorNext(&a);
+        CursorNext(&b);
+    }
+}
@@ -0,0 +1,85 @@
+/*
+ * tracefile.c: Defines the binary trace format and its conversion to text lines
+ */
+
+#include "tracefile.h"
+
+__thread int TraceFormat = TRACE_TEXT;
+
+static const char hexDigits[] = "0123456789ABCDEF";
+
+/*
+ * Fill in the trace record for the current state of the CPU.
+ */
+void FillTraceRecord(MachineState* CPU, TraceRecord* record)
+{
+    record->PC = CPU->PC;
+    record->inst = CPU->memory[CPU->PC];
+    record->regFile_WE = CPU->regFile_WE;
+    record->rd = CPU->regFile_WE ? CPU->rdMux_CTL : 0;
+    record->regInputVal = CPU->regFile_WE ? CPU->regInputVal : 0;
+    record->NZP_WE = CPU->NZP_WE;
+    record->NZPVal = CPU->NZP_WE ? CPU->NZPVal : 0;
+    record->DATA_WE = CPU->DATA_WE;
+    record->unused = 0;
+    record->dmemAddr = CPU->dmemAddr;
+    record->dmemValue = CPU->dmemValue;
+}
+
+//helper function to write value as 4 hex digits
+static char* PutHex(char* p, unsigned short int value)
+{
+    p[0] = hexDigits[value >> 12 & 0xF];
+    p[1] = hexDigits[value >> 8 & 0xF];
+    p[2] = hexDigits[value >> 4 & 0xF];
+    p[3] = hexDigits[value & 0xF];
+    return p + 4;
+}
+
+//helper function to write a small control value as WriteOut's %d does
+static char* PutDecimal(char* p, unsigned char value)
+{
+    if (value >= 100) {
+        *p++ = '0' + value / 100;
+    }
+    if (value >= 10) {
+        *p++ = '0' + value / 10 % 10;
+    }
+    *p++ = '0' + value % 10;
+    return p;
+}
+
+/*
+ * Write the text line WriteOut would produce for record into line (newline
+ * included, not null terminated). Returns the number of characters written.
+ */
+int FormatTraceRecord(const TraceRecord* record, char* line)
+{
+    char* p = line;
+    int i;
+
+    p = PutHex(p, record->PC);
+    *p++ = ' ';
+    for (i = 0; i < 16; i++) {
+        *p++ = (record->inst << i) & 0x8000 ? '1' : '0';
+    }
+    *p++ = ' ';
+    p = PutDecimal(p, record->regFile_WE);
+    *p++ = ' ';
+    p = PutDecimal(p, record->rd);
+    *p++ = ' ';
+    p = PutHex(p, record->regInputVal);
+    *p++ = ' ';
+    p = PutDecimal(p, record->NZP_WE);
+    *p++ = ' ';
+    p = PutDecimal(p, record->NZPVal);
+    *p++ = ' ';
+    p = PutDecimal(p, record->DATA_WE);
+    *p++ = ' ';
+    p = PutHex(p, record->dmemAddr);
+    *p++ = ' ';
+    p = PutHex(p, record->dmemValue);
+    *p++ = '\n';
+
+    return p - line;
+}
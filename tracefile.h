@@ -0,0 +1,52 @@
+/*
+ * tracefile.h: Declares the binary trace format and its conversion to text lines
+ */
+
+#ifndef LC4_TRACEFILE_H
+#define LC4_TRACEFILE_H
+
+#include "LC4.h"
+
+// How WriteOut writes the trace
+#define TRACE_TEXT 0
+#define TRACE_BINARY 1
+
+// A binary trace starts with this 8 byte tag, followed by one record per cycle
+#define TRACE_MAGIC "LC4TRC01"
+#define TRACE_MAGIC_LENGTH 8
+
+// Longest text line tracediff reads, including the newline: the fields,
+// the state hash column and the disassembly column with a label
+#define TRACE_LINE_MAX 256
+
+// One line of the trace in binary form (16 bytes, host byte order). Fields
+// hold exactly what the text line shows, so unused ones are 0.
+typedef struct {
+    unsigned short int PC;
+    unsigned short int inst;
+    unsigned char regFile_WE;
+    unsigned char rd;
+    unsigned short int regInputVal;
+    unsigned char NZP_WE;
+    unsigned char NZPVal;
+    unsigned char DATA_WE;
+    unsigned char unused;
+    unsigned short int dmemAddr;
+    unsigned short int dmemValue;
+} TraceRecord;
+
+// Per thread, so the jobs of a server can each pick their own format
+extern __thread int TraceFormat;
+
+/*
+ * Fill in the trace record for the current state of the CPU.
+ */
+void FillTraceRecord(MachineState* CPU, TraceRecord* record);
+
+/*
+ * Write the text line WriteOut would produce for record into line (newline
+ * included, not null terminated). Returns the number of characters written.
+ */
+int FormatTraceRecord(const TraceRecord* record, char* line);
+
+#endif
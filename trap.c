@@ -0,0 +1,82 @@
+/*
+ * trap.c: Defines high-level emulation of the standard OS TRAP routines
+ */
+
+#include "trap.h"
+#include "devices.h"
+#include "statehash.h"
+
+// user data region that the string traps are allowed to touch
+#define USER_DATA_START 0x2000
+#define USER_DATA_END 0x8000
+
+int TrapMode = TRAP_MODE_OS;
+
+/*
+ * Carry out the trap routine for vector natively, leaving the machine as if
+ * the OS routine had finished with RTI. Returns 1 if the trap was emulated,
+ * 0 if the OS has to run it.
+ */
+int TrapEmulate(MachineState* CPU, unsigned short int vector, FILE* output)
+{
+    unsigned short int address;
+    unsigned short int c;
+
+    // the trace has to show the OS instructions, so let the OS run
+    if (TrapMode == TRAP_MODE_HLE_STRICT && output != NULL) {
+        return 0;
+    }
+
+    switch (vector) {
+        case TRAP_GETC:         // R0 = next character
+        case TRAP_GETC_TIMER:   // input is a file or pipe, so it never times out
+            CPU->R[0] = ConsoleGetc();
+            break;
+        case TRAP_PUTC:         // display R0
+            ConsolePutc(CPU->R[0]);
+            break;
+        case TRAP_GETS:         // read a line into dmem[R0], R1 = length
+            address = CPU->R[0];
+            if (address < USER_DATA_START || address >= USER_DATA_END) {
+                return 0;   // let the OS reject the bad address
+            }
+            CPU->R[1] = 0;
+            while (address < USER_DATA_END - 1) {
+                c = ConsoleGetc();
+                if (c == 0 || c == '\n') {
+                    break;
+                }
+                if (StateHashOn) {
+                    StateHashWrite(CPU, address, c);
+                }
+                CPU->memory[address++] = c;
+                CPU->R[1]++;
+            }
+            if (StateHashOn) {
+                StateHashWrite(CPU, address, 0);
+            }
+            CPU->memory[address] = 0;
+            break;
+        case TRAP_PUTS:         // display the null terminated string at dmem[R0]
+            address = CPU->R[0];
+            if (address < USER_DATA_START || address >= USER_DATA_END) {
+                return 0;   // let the OS reject the bad address
+            }
+            while (address < USER_DATA_END && CPU->memory[address] != 0) {
+                ConsolePutc(CPU->memory[address++]);
+            }
+            break;
+        case TRAP_TIMER:        // host time does not advance with simulated time
+            break;
+        case TRAP_CORE_ID:      // what the OS would read from the core ID register
+            CPU->R[0] = DeviceLoad(CPU, OS_CORE_ID);
+            break;
+        default:                // not a standard routine
+            return 0;
+    }
+
+    // return as if RTI had executed: PC = R7, PSR[15] = 0
+    CPU->PC = CPU->R[7];
+    CPU->PSR = CPU->PSR & 0x7FFF;
+    return 1;
+}
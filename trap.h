@@ -0,0 +1,34 @@
+/*
+ * trap.h: Declares high-level emulation of the standard OS TRAP routines
+ */
+
+#ifndef LC4_TRAP_H
+#define LC4_TRAP_H
+
+#include <stdio.h>
+#include "LC4.h"
+
+// How TRAP instructions are carried out
+#define TRAP_MODE_OS 0          // jump into the OS and run it instruction by instruction
+#define TRAP_MODE_HLE 1         // emulate the standard routines natively
+#define TRAP_MODE_HLE_STRICT 2  // emulate only while no trace is being written
+
+// Standard trap vectors of the LC4 OS
+#define TRAP_GETC 0x00
+#define TRAP_PUTC 0x01
+#define TRAP_GETS 0x02
+#define TRAP_PUTS 0x03
+#define TRAP_TIMER 0x04
+#define TRAP_GETC_TIMER 0x05
+#define TRAP_CORE_ID 0x06       // R0 = number of the core (see multicore.h)
+
+extern int TrapMode;
+
+/*
+ * Carry out the trap routine for vector natively, leaving the machine as if
+ * the OS routine had finished with RTI. Returns 1 if the trap was emulated,
+ * 0 if the OS has to run it.
+ */
+int TrapEmulate(MachineState* CPU, unsigned short int vector, FILE* output);
+
+#endif